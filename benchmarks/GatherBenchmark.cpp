@@ -0,0 +1,95 @@
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "junctions/EntityManager.h"
+
+namespace {
+
+// A component big enough that every lookup touches its own cache line.
+struct Body {
+  float position[4];
+  float velocity[4];
+  float mass;
+  float padding[7];
+
+  explicit Body(float mass) : position{}, velocity{}, mass(mass), padding{} {}
+};
+
+constexpr USize kEntityCount = 1 << 20;
+constexpr USize kLookupCount = 1 << 22;
+constexpr int kRepeatCount = 5;
+
+template <typename Func>
+double measureNanosecondsPerLookup(Func func) {
+  double best = 0.0;
+  for (int i = 0; i < kRepeatCount; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count() / kLookupCount;
+    if (i == 0 || nanoseconds < best) {
+      best = nanoseconds;
+    }
+  }
+  return best;
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 random{1234};
+
+  ju::EntityManager entities;
+  for (USize i = 0; i < kEntityCount; ++i) {
+    entities.addComponent<Body>(entities.createEntity(), static_cast<float>(i % 100));
+  }
+
+  // Shuffle the storage, so that neighbouring entity ID's are not neighbours in memory.
+  std::vector<U32> keys(kEntityCount);
+  for (U32& key : keys) {
+    key = random();
+  }
+  entities.sortComponentsByEntity<Body>([&keys](ju::EntityId left, ju::EntityId right) {
+    return keys[left] < keys[right];
+  });
+
+  // Random ID's, like the pairs coming out of a broad phase.
+  std::uniform_int_distribution<ju::EntityId> idDistribution{0, kEntityCount - 1};
+  std::vector<ju::EntityId> ids(kLookupCount);
+  for (ju::EntityId& id : ids) {
+    id = idDistribution(random);
+  }
+
+  volatile float sink = 0.f;
+
+  double perId = measureNanosecondsPerLookup([&]() {
+    float total = 0.f;
+    for (ju::EntityId id : ids) {
+      total += entities.getComponent<Body>(id)->mass;
+    }
+    sink = total;
+  });
+
+  // Resolve the ID's in batches small enough that the components are still in cache when we use them.
+  constexpr USize kBatchSize = 256;
+  Body* pointers[kBatchSize];
+  double batched = measureNanosecondsPerLookup([&]() {
+    float total = 0.f;
+    for (USize begin = 0; begin < kLookupCount; begin += kBatchSize) {
+      entities.getComponents(ids.data() + begin, kBatchSize, pointers);
+      for (Body* body : pointers) {
+        total += body->mass;
+      }
+    }
+    sink = total;
+  });
+
+  std::printf("getComponent per ID:    %6.2f ns/lookup\n", perId);
+  std::printf("getComponents batched:  %6.2f ns/lookup (%.2fx)\n", batched, perId / batched);
+
+  return 0;
+}
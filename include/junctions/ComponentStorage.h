@@ -0,0 +1,453 @@
+
+#ifndef JUNCTIONS_COMPONENT_STORAGE_H_
+#define JUNCTIONS_COMPONENT_STORAGE_H_
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "junctions/Entity.h"
+#include "nucleus/Logging.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Types.h"
+#include "nucleus/Utils/Move.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#endif
+
+namespace ju {
+
+namespace detail {
+
+// Hint to the CPU that we will read from the address soon.
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+}
+
+// How many lookups ahead batched lookups prefetch the component.  The sparse index is prefetched twice as far ahead, so
+// that it is in cache by the time we need it to find the component.
+static constexpr USize kPrefetchDistance = 16;
+
+struct GroupData;
+
+static constexpr USize kInvalidComponentIndex = std::numeric_limits<USize>::max();
+
+// The average number of swaps per component we allow an insertion sort to make before falling back to a full sort.
+static constexpr USize kInsertionSortSwapsPerComponent = 8;
+
+// Sparse set of components of a single type.  Components are stored packed together in a dense array and each entity
+// maps to its slot in that array through a sparse index.
+class ComponentStorageBase {
+public:
+  ComponentStorageBase() : m_group(nullptr), m_snapshotsEnabled(false), m_layoutVersion(0) {}
+  virtual ~ComponentStorageBase() {}
+
+  // Returns the number of components in the storage.
+  USize getSize() const {
+    return m_entityIds.size();
+  }
+
+  // Returns the packed array of entity ID's, in the same order as the components.
+  const EntityId* getEntityIds() const {
+    return m_entityIds.data();
+  }
+
+  // Returns true if the entity with the given ID has a component in this storage.
+  bool contains(EntityId id) const {
+    return id < m_sparse.size() && m_sparse[id] != kInvalidComponentIndex;
+  }
+
+  // Returns the index into the dense array for the entity with the given ID.
+  USize indexOf(EntityId id) const {
+    DCHECK(contains(id));
+    return m_sparse[id];
+  }
+
+  // Returns a number that changes whenever an entity is added to, removed from or moved in the dense array, so that
+  // callers can tell if indices they cached are still valid.
+  U64 getLayoutVersion() const {
+    return m_layoutVersion;
+  }
+
+  // Returns the group that owns this storage, or null if it isn't owned.
+  GroupData* getGroup() const {
+    return m_group;
+  }
+
+  // Set the group that owns this storage.
+  void setGroup(GroupData* group) {
+    DCHECK(!m_group || !group) << "A component type can only be owned by one group.";
+    m_group = group;
+  }
+
+  // Returns the size of a single component in bytes.
+  virtual USize getComponentSize() const = 0;
+
+  // Returns the number of components the storage can hold without growing.
+  virtual USize getCapacity() const = 0;
+
+  // Returns the number of bytes allocated by the storage.
+  USize getMemoryUsage() const {
+    return getCapacity() * getComponentSize() + m_entityIds.capacity() * sizeof(EntityId) +
+           m_sparse.capacity() * sizeof(USize) + getSnapshotMemoryUsage();
+  }
+
+  // Returns the number of heap allocations owned by the storage, not counting those owned by components themselves.
+  USize getAllocationCount() const {
+    return (getCapacity() ? 1 : 0) + (m_entityIds.capacity() ? 1 : 0) + (m_sparse.capacity() ? 1 : 0) +
+           getSnapshotAllocationCount();
+  }
+
+  // Returns true if the storage keeps a snapshot of its components.
+  bool areSnapshotsEnabled() const {
+    return m_snapshotsEnabled;
+  }
+
+  // Start keeping a snapshot of the components, updated by each call to updateSnapshot().
+  void enableSnapshots() {
+    m_snapshotsEnabled = true;
+    updateSnapshot();
+  }
+
+  // Replace the snapshot with a copy of the current components.
+  virtual void updateSnapshot() = 0;
+
+  // Returns the number of bytes allocated for the snapshot.
+  virtual USize getSnapshotMemoryUsage() const = 0;
+
+  // Returns the number of heap allocations made for the snapshot.
+  virtual USize getSnapshotAllocationCount() const = 0;
+
+  // Returns the number of entity ID's the sparse index covers.
+  USize getSparseSize() const {
+    return m_sparse.size();
+  }
+
+  // Swap the components, and their entities, at the two indices in the dense array.
+  virtual void swapIndices(USize left, USize right) = 0;
+
+  // Remove the component for the entity with the given ID.
+  virtual void remove(EntityId id) = 0;
+
+  // Sort the range [begin, end) of the dense array by entity ID using a comparison function with a signature similar
+  // to:
+  //
+  //   bool compare(EntityId left, EntityId right);
+  //
+  // Each swap is done by calling swapFunc(left, right), so that callers can keep other storages in step.
+  template <typename Compare, typename SwapFunc>
+  void sortByEntity(USize begin, USize end, Compare compare, SwapFunc swapFunc) {
+    sortIndices(begin, end,
+                [this, &compare](USize left, USize right) { return compare(m_entityIds[left], m_entityIds[right]); },
+                swapFunc);
+  }
+
+  // Add a copy of the source entity's component to the destination entity.  Returns false if the component type can't
+  // be copied.
+  virtual bool copyComponent(EntityId source, EntityId destination) = 0;
+
+  // Create an empty storage for the same type of component.
+  virtual ComponentStorageBase* createEmpty() const = 0;
+
+  // Move the component of the entity with the given ID into the destination storage, which must be for the same type
+  // of component, as the component of the destination entity.  The moved from component stays in this storage until it
+  // is removed.
+  virtual void moveComponentTo(EntityId id, ComponentStorageBase* destination, EntityId destinationId) = 0;
+
+protected:
+  // Sort the range [begin, end) of the dense array, where lessFunc(left, right) compares the entries at two indices and
+  // swapFunc(left, right) swaps them.
+  //
+  // An insertion sort is used first, because storages that are sorted regularly are mostly sorted already.  If the
+  // entries are too far out of order, we fall back to sorting an index array and applying the permutation.
+  template <typename LessFunc, typename SwapFunc>
+  void sortIndices(USize begin, USize end, LessFunc lessFunc, SwapFunc& swapFunc) {
+    USize budget = (end - begin) * kInsertionSortSwapsPerComponent;
+
+    for (USize i = begin + 1; i < end; ++i) {
+      for (USize j = i; j > begin && lessFunc(j, j - 1); --j) {
+        if (budget-- == 0) {
+          sortByPermutation(begin, end, lessFunc, swapFunc);
+          return;
+        }
+        swapFunc(j - 1, j);
+      }
+    }
+  }
+
+  template <typename LessFunc, typename SwapFunc>
+  void sortByPermutation(USize begin, USize end, LessFunc& lessFunc, SwapFunc& swapFunc) {
+    // Find the order the entries should be in.
+    std::vector<USize> order(end - begin);
+    for (USize i = begin; i < end; ++i) {
+      order[i - begin] = i;
+    }
+    std::stable_sort(std::begin(order), std::end(order), lessFunc);
+
+    // Walk each cycle of the permutation, swapping the right entry into place as we go.
+    for (USize i = begin; i < end; ++i) {
+      USize current = i;
+      for (;;) {
+        USize source = order[current - begin];
+        order[current - begin] = current;
+        if (source == i) {
+          break;
+        }
+        swapFunc(current, source);
+        current = source;
+      }
+    }
+  }
+
+  // Make room for the given number of new entities.
+  void reserveEntities(USize count) {
+    m_entityIds.reserve(m_entityIds.size() + count);
+  }
+
+  // Append the entity to the dense array and return its index.
+  USize insertEntity(EntityId id) {
+    if (id >= m_sparse.size()) {
+      m_sparse.resize(id + 1, kInvalidComponentIndex);
+    }
+
+    USize index = m_entityIds.size();
+    m_sparse[id] = index;
+    m_entityIds.push_back(id);
+    ++m_layoutVersion;
+    return index;
+  }
+
+  // Swap the entities at the two dense indices and update the sparse index.
+  void swapEntities(USize left, USize right) {
+    using std::swap;
+    swap(m_entityIds[left], m_entityIds[right]);
+    m_sparse[m_entityIds[left]] = left;
+    m_sparse[m_entityIds[right]] = right;
+    ++m_layoutVersion;
+  }
+
+  // Remove the entity at the back of the dense array.
+  void popEntity() {
+    m_sparse[m_entityIds.back()] = kInvalidComponentIndex;
+    m_entityIds.pop_back();
+    ++m_layoutVersion;
+  }
+
+  // Entity ID's packed in the same order as the components.
+  std::vector<EntityId> m_entityIds;
+
+  // Maps entity ID's to indices in the dense array.
+  std::vector<USize> m_sparse;
+
+  // The group that owns this storage, if any.
+  GroupData* m_group;
+
+  // Set when the storage keeps a snapshot of its components.
+  bool m_snapshotsEnabled;
+
+  // Incremented whenever the dense array changes layout.
+  U64 m_layoutVersion;
+};
+
+template <typename ComponentType>
+class ComponentStorage : public ComponentStorageBase {
+  // Components are moved when the dense array grows, when other components are swapped into their slot and when they
+  // are replaced.
+  static_assert(std::is_move_constructible<ComponentType>::value && std::is_move_assignable<ComponentType>::value,
+                "Components must be move constructible and move assignable.");
+
+public:
+  ComponentStorage() = default;
+  ~ComponentStorage() override {}
+
+  // Returns the packed array of components.
+  ComponentType* getComponents() {
+    return m_components.data();
+  }
+
+  // Construct a new component for the entity with the given ID.  If the entity already has a component of this type,
+  // it is replaced.
+  template <typename... Args>
+  ComponentType* emplace(EntityId id, Args&&... args) {
+    if (contains(id)) {
+      ComponentType& component = m_components[indexOf(id)];
+      component = ComponentType(nu::forward<Args>(args)...);
+      return &component;
+    }
+
+    insertEntity(id);
+    m_components.emplace_back(nu::forward<Args>(args)...);
+    return &m_components.back();
+  }
+
+  // Insert a copy of the prototype for each of the given entities, none of which may have a component in this storage
+  // yet.  Copies of trivially copyable types are made in bulk.
+  void insertCopies(const EntityId* entityIds, USize count, const ComponentType& prototype) {
+    reserveEntities(count);
+    for (USize i = 0; i < count; ++i) {
+      DCHECK(!contains(entityIds[i]));
+      insertEntity(entityIds[i]);
+    }
+
+    m_components.insert(std::end(m_components), count, prototype);
+  }
+
+  // Returns the component for the entity with the given ID or null if the entity doesn't have one.
+  ComponentType* get(EntityId id) {
+    if (!contains(id)) {
+      return nullptr;
+    }
+    return &m_components[m_sparse[id]];
+  }
+
+  // Look up the components of count entities, storing a pointer to each in out, or null if the entity doesn't have
+  // one.  Lookups further ahead are prefetched, so that their cache misses overlap.
+  void gather(const EntityId* entityIds, USize count, ComponentType** out) {
+    for (USize i = 0; i < count; ++i) {
+      if (i + 2 * kPrefetchDistance < count && entityIds[i + 2 * kPrefetchDistance] < m_sparse.size()) {
+        prefetch(&m_sparse[entityIds[i + 2 * kPrefetchDistance]]);
+      }
+      if (i + kPrefetchDistance < count && contains(entityIds[i + kPrefetchDistance])) {
+        prefetch(&m_components[m_sparse[entityIds[i + kPrefetchDistance]]]);
+      }
+
+      out[i] = get(entityIds[i]);
+    }
+  }
+
+  // Sort the components in the range [begin, end) of the dense array using a comparison function with a signature
+  // similar to:
+  //
+  //   bool compare(const ComponentType& left, const ComponentType& right);
+  //
+  // Each swap is done by calling swapFunc(left, right), so that callers can keep other storages in step.
+  template <typename Compare, typename SwapFunc>
+  void sort(USize begin, USize end, Compare compare, SwapFunc swapFunc) {
+    sortIndices(begin, end,
+                [this, &compare](USize left, USize right) { return compare(m_components[left], m_components[right]); },
+                swapFunc);
+  }
+
+  USize getComponentSize() const override {
+    return sizeof(ComponentType);
+  }
+
+  USize getCapacity() const override {
+    return m_components.capacity();
+  }
+
+  void swapIndices(USize left, USize right) override {
+    if (left == right) {
+      return;
+    }
+
+    using std::swap;
+    swap(m_components[left], m_components[right]);
+    swapEntities(left, right);
+  }
+
+  void remove(EntityId id) override {
+    // Move the component to the back and pop it off.
+    swapIndices(indexOf(id), m_components.size() - 1);
+    m_components.pop_back();
+    popEntity();
+  }
+
+  bool copyComponent(EntityId source, EntityId destination) override {
+    return copyComponentInternal(source, destination, std::is_copy_constructible<ComponentType>{});
+  }
+
+  ComponentStorageBase* createEmpty() const override {
+    return new ComponentStorage<ComponentType>;
+  }
+
+  void moveComponentTo(EntityId id, ComponentStorageBase* destination, EntityId destinationId) override {
+    static_cast<ComponentStorage<ComponentType>*>(destination)->emplace(destinationId,
+                                                                         nu::move(m_components[indexOf(id)]));
+  }
+
+  // Returns the component for the entity with the given ID in the snapshot, or null if the entity didn't have one when
+  // the snapshot was taken.
+  const ComponentType* getSnapshot(EntityId id) const {
+    if (id >= m_snapshot.sparse.size() || m_snapshot.sparse[id] == kInvalidComponentIndex) {
+      return nullptr;
+    }
+    return &m_snapshot.components[m_snapshot.sparse[id]];
+  }
+
+  // Call the function for each component in the snapshot, with a signature similar to:
+  //
+  //   void func(EntityId id, const ComponentType& component);
+  template <typename Func>
+  void eachSnapshot(Func& func) const {
+    for (USize i = 0; i < m_snapshot.entityIds.size(); ++i) {
+      func(m_snapshot.entityIds[i], m_snapshot.components[i]);
+    }
+  }
+
+  void updateSnapshot() override {
+    updateSnapshotInternal(std::is_copy_constructible<ComponentType>{});
+  }
+
+  USize getSnapshotMemoryUsage() const override {
+    return m_snapshot.components.capacity() * sizeof(ComponentType) +
+           m_snapshot.entityIds.capacity() * sizeof(EntityId) + m_snapshot.sparse.capacity() * sizeof(USize);
+  }
+
+  USize getSnapshotAllocationCount() const override {
+    return (m_snapshot.components.capacity() ? 1 : 0) + (m_snapshot.entityIds.capacity() ? 1 : 0) +
+           (m_snapshot.sparse.capacity() ? 1 : 0);
+  }
+
+private:
+  // A copy of the storage as it was at the last call to updateSnapshot().
+  struct Snapshot {
+    std::vector<ComponentType> components;
+    std::vector<EntityId> entityIds;
+    std::vector<USize> sparse;
+  };
+
+  void updateSnapshotInternal(std::true_type) {
+    // Assigning reuses the memory of the previous snapshot, so this is a plain copy once the sizes settle.
+    m_snapshot.components = m_components;
+    m_snapshot.entityIds = m_entityIds;
+    m_snapshot.sparse = m_sparse;
+  }
+
+  void updateSnapshotInternal(std::false_type) {
+    DCHECK(false) << "Only copy constructible components can have snapshots.";
+  }
+
+  bool copyComponentInternal(EntityId source, EntityId destination, std::true_type) {
+    DCHECK(!contains(destination));
+
+    USize index = indexOf(source);
+    insertEntity(destination);
+    m_components.push_back(m_components[index]);
+    return true;
+  }
+
+  bool copyComponentInternal(EntityId, EntityId, std::false_type) {
+    return false;
+  }
+
+  // The packed array of components.
+  std::vector<ComponentType> m_components;
+
+  // The components as they were at the last snapshot.
+  Snapshot m_snapshot;
+
+  DISALLOW_COPY_AND_ASSIGN(ComponentStorage);
+};
+
+}  // namespace detail
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_COMPONENT_STORAGE_H_
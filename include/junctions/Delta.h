@@ -0,0 +1,144 @@
+
+#ifndef JUNCTIONS_DELTA_H_
+#define JUNCTIONS_DELTA_H_
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "junctions/EntityManager.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Types.h"
+
+namespace ju {
+
+namespace detail {
+
+// Type erased access to a component type that is replicated through deltas.
+struct DeltaComponentInfo {
+  // The size of the component in bytes.
+  USize size;
+
+  // Returns the component of the entity or null if it doesn't have one.
+  const void* (*getComponent)(EntityManager& entities, EntityId id);
+
+  // Returns the component of the entity, adding a zeroed component if it doesn't have one.
+  void* (*getOrAddComponent)(EntityManager& entities, EntityId id);
+};
+
+template <typename ComponentType>
+const void* getDeltaComponent(EntityManager& entities, EntityId id) {
+  return entities.getComponent<ComponentType>(id);
+}
+
+template <typename ComponentType>
+void* getOrAddDeltaComponent(EntityManager& entities, EntityId id) {
+  ComponentType* component = entities.getComponent<ComponentType>(id);
+  if (component) {
+    return component;
+  }
+
+  typename std::aligned_storage<sizeof(ComponentType), alignof(ComponentType)>::type zeroed;
+  std::memset(&zeroed, 0, sizeof(zeroed));
+  return entities.addComponent<ComponentType>(id, *reinterpret_cast<const ComponentType*>(&zeroed));
+}
+
+template <typename ComponentType>
+DeltaComponentInfo createDeltaComponentInfo() {
+  static_assert(std::is_trivially_copyable<ComponentType>::value, "Only trivially copyable components can be replicated.");
+  return DeltaComponentInfo{sizeof(ComponentType), &getDeltaComponent<ComponentType>,
+                            &getOrAddDeltaComponent<ComponentType>};
+}
+
+}  // namespace detail
+
+// Writes the changes made to an entity manager since the previous call to encode() into a compact binary delta: the
+// entities that were created and destroyed, the components they gained and the ranges of bytes that changed in each
+// registered component.  Each encoder keeps its own copy of the state it last encoded, so several consumers at
+// different ticks each need their own encoder.
+class DeltaEncoder {
+public:
+  explicit DeltaEncoder(EntityManager* entities);
+  ~DeltaEncoder();
+
+  // Register a trivially copyable component type to replicate.  Component types must be registered in the same order
+  // on the DeltaDecoder that applies the deltas.
+  template <typename ComponentType>
+  void registerComponent() {
+    DCHECK(m_components.size() < Entity::kMaxComponents) << "Too many replicated components.";
+
+    // Components registered after the first encode start with an empty baseline for every known entity, so they are
+    // sent in full by the next encode.
+    detail::DeltaComponentInfo info = detail::createDeltaComponentInfo<ComponentType>();
+    m_components.push_back(Component{info, std::vector<U8>(m_alive.size() * info.size, 0)});
+  }
+
+  // Append a delta of all changes since the previous call to the buffer.  The first delta contains everything.
+  void encode(std::vector<U8>* buffer);
+
+private:
+  struct Component {
+    detail::DeltaComponentInfo info;
+
+    // The component bytes of every entity at the previous encode, zero if it didn't have the component.
+    std::vector<U8> baseline;
+  };
+
+  // Forget everything about the entity with the given ID.
+  void resetBaseline(EntityId id);
+
+  // The entity manager we are encoding.
+  EntityManager* m_entities;
+
+  // The replicated component types.
+  std::vector<Component> m_components;
+
+  // For each entity, whether it was alive at the previous encode.
+  std::vector<bool> m_alive;
+
+  // For each entity, a bit per replicated component it had at the previous encode.
+  std::vector<U32> m_masks;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(DeltaEncoder);
+};
+
+// Applies deltas written by a DeltaEncoder to an entity manager.  The entity manager must start out empty and may only
+// be changed by applying deltas, so that its entity ID's match those of the source.
+class DeltaDecoder {
+public:
+  explicit DeltaDecoder(EntityManager* entities);
+  ~DeltaDecoder();
+
+  // Register a trivially copyable component type to replicate, in the same order as on the DeltaEncoder.
+  template <typename ComponentType>
+  void registerComponent() {
+    DCHECK(m_components.size() < Entity::kMaxComponents) << "Too many replicated components.";
+    m_components.push_back(detail::createDeltaComponentInfo<ComponentType>());
+  }
+
+  // Refuse deltas that would grow the entity manager to more than the given number of entity ID's, so that a corrupt
+  // delta can't make us create entities without limit.  Defaults to 2^20.
+  void setMaxEntityCount(EntityId maxEntityCount) {
+    m_maxEntityCount = maxEntityCount;
+  }
+
+  // Apply the delta to the entity manager.  Returns false if the delta is malformed, in which case the entity manager
+  // may have been partially updated.
+  bool apply(const U8* data, USize size);
+
+private:
+  // The entity manager we are applying deltas to.
+  EntityManager* m_entities;
+
+  // The replicated component types.
+  std::vector<detail::DeltaComponentInfo> m_components;
+
+  // The largest number of entity ID's a delta may grow the entity manager to.
+  EntityId m_maxEntityCount;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(DeltaDecoder);
+};
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_DELTA_H_
@@ -2,17 +2,15 @@
 #ifndef JUNCTIONS_ENTITY_H_
 #define JUNCTIONS_ENTITY_H_
 
-#include <array>
+#include <atomic>
 #include <bitset>
 #include <limits>
-#include <memory>
 
 #include "junctions/Utils.h"
 #include "nucleus/Containers/BitSet.h"
 #include "nucleus/Containers/DynamicArray.h"
 #include "nucleus/Logging.h"
 #include "nucleus/Macros.h"
-#include "nucleus/Memory/ScopedPtr.h"
 #include "nucleus/Types.h"
 #include "nucleus/Utils/Move.h"
 
@@ -22,9 +20,11 @@ using ComponentId = USize;
 
 namespace detail {
 
+// Component ID's are handed out the first time a type is used, which can happen on any thread that is updating a
+// shard, so the counter has to be atomic.
 inline ComponentId getUniqueComponentId() {
-  static ComponentId nextId = 0;
-  return nextId++;
+  static std::atomic<ComponentId> nextId{0};
+  return nextId.fetch_add(1);
 }
 
 template <typename ComponentType>
@@ -33,18 +33,6 @@ inline ComponentId getComponentId() {
   return componentId;
 }
 
-struct ComponentWrapperBase {
-  virtual ~ComponentWrapperBase() {}
-};
-
-template <typename ComponentType>
-struct ComponentWrapper : public ComponentWrapperBase {
-  nu::ScopedPtr<ComponentType> component;
-
-  ComponentWrapper(nu::ScopedPtr<ComponentType> component) : component(move(component)) {}
-  virtual ~ComponentWrapper() {}
-};
-
 }  // namespace detail
 
 class Entity;
@@ -61,13 +49,13 @@ public:
   // using ComponentMask = std::bitset<kMaxComponents>;
   using ComponentMask = nu::BitSet<kMaxComponents>;
 
-  explicit Entity(EntityId entityId) : m_id(entityId), m_remove(false) {}
+  Entity(EntityManager* manager, EntityId entityId) : m_manager(manager), m_id(entityId), m_remove(false) {}
 
   Entity(Entity&& other) {
     using std::swap;
+    swap(m_manager, other.m_manager);
     swap(m_id, other.m_id);
     swap(m_mask, other.m_mask);
-    swap(m_components, other.m_components);
   }
 
   // Returns this entity's ID.
@@ -99,44 +87,16 @@ public:
     return m_mask;
   }
 
-  // Add a component to this entity and return the newly created component.
+  // Add a component to this entity and return the newly created component.  The component is stored packed with all
+  // the other components of its type in the entity manager, so the pointer is only valid until the next structural
+  // change to that storage.  See EntityManager::addComponent() for what those are.
   template <typename ComponentType, typename... Args>
-  ComponentType* addComponent(Args&&... args) {
-    using WrapperType = detail::ComponentWrapper<ComponentType>;
-
-    // Get the ID for the component.
-    ComponentId componentId = detail::getComponentId<ComponentType>();
-
-    ComponentType* component = new ComponentType(nu::forward<Args>(args)...);
-
-    // Add the new component to our list of components.
-    m_components[componentId].reset(new WrapperType{component});
-
-    // Set the component in our mask.
-    m_mask.set(componentId);
-
-    // Return the new component.
-    return component;
-  }
+  ComponentType* addComponent(Args&&... args);
 
   // Get the specified component from this entity.  Returns null if this entity
   // doesn't have the specified type of component.
   template <typename ComponentType>
-  ComponentType* getComponent() const {
-    using WrapperType = detail::ComponentWrapper<ComponentType>;
-
-    // Get the ID for the component.
-    ComponentId componentId = detail::getComponentId<ComponentType>();
-
-    // Get the wrapper.
-    const auto& wrapper = m_components.at(componentId);
-    if (!wrapper) {
-      return nullptr;
-    }
-
-    // Return the correct type from the wrapper.
-    return static_cast<WrapperType*>(wrapper.get())->component.get();
-  }
+  ComponentType* getComponent() const;
 
   bool operator==(const Entity& right) const {
     return m_id == right.m_id;
@@ -172,15 +132,15 @@ private:
   // Reset the entity to a blank state.
   void resetInternal();
 
+  // The manager that owns this entity and its components.
+  EntityManager* m_manager;
+
   // The ID of the component.  This is unique per entity manager and won't change after the entity was created.
   EntityId m_id;
 
   // We build up a mask with each bit representing a component that we have.
   ComponentMask m_mask;
 
-  // Map component type id's to component instances.
-  std::array<nu::ScopedPtr<detail::ComponentWrapperBase>, kMaxComponents> m_components;
-
   // Set to true if the entity should be removed on next update.
   bool m_remove;
 
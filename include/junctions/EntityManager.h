@@ -2,14 +2,25 @@
 #ifndef JUNCTIONS_ENTITY_MANAGER_H_
 #define JUNCTIONS_ENTITY_MANAGER_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <initializer_list>
 #include <iterator>
 #include <set>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
+#include "junctions/ComponentStorage.h"
 #include "junctions/Entity.h"
+#include "junctions/Group.h"
+#include "junctions/Hierarchy.h"
+#include "junctions/Prefab.h"
 #include "nucleus/Containers/DynamicArray.h"
 #include "nucleus/Logging.h"
 #include "nucleus/Macros.h"
+#include "nucleus/Memory/ScopedPtr.h"
 #include "nucleus/Utils/Signals.h"
 
 namespace ju {
@@ -32,6 +43,44 @@ struct SignalWrapper {
   }
 };
 
+inline USize getUniqueSingletonId() {
+  static std::atomic<USize> nextId{0};
+  return nextId.fetch_add(1);
+}
+
+template <typename SingletonType>
+inline USize getSingletonId() {
+  static USize singletonId = getUniqueSingletonId();
+  return singletonId;
+}
+
+struct SingletonWrapperBase {
+  virtual ~SingletonWrapperBase() {}
+};
+
+template <typename SingletonType>
+struct SingletonWrapper : public SingletonWrapperBase {
+  SingletonType singleton;
+
+  template <typename... Args>
+  explicit SingletonWrapper(Args&&... args) : singleton(nu::forward<Args>(args)...) {}
+  ~SingletonWrapper() override {}
+};
+
+// The order in which EntityManager::propagate() visits the components of one type.
+struct PropagationOrder {
+  // Indices into the dense array, with parents before their children.
+  std::vector<USize> indices;
+
+  // For each entry in indices, the index of the parent's component, or kInvalidComponentIndex if there is none.
+  std::vector<USize> parentIndices;
+
+  // The layout version of the storage and the version of the hierarchy the order was built from.  An empty storage
+  // starts with the same versions as an empty order.
+  U64 layoutVersion{0};
+  U64 hierarchyVersion{0};
+};
+
 }  // namespace detail
 
 class EntityManager {
@@ -110,15 +159,147 @@ public:
     Entity::ComponentMask m_mask;
   };
 
-  EntityManager() {}
+  // Memory usage of the components of a single type.
+  struct ComponentStats {
+    // The ID of the component type.
+    ComponentId componentId;
+
+    // The number of components.
+    USize count;
+
+    // The number of components that fit in the storage without it growing.
+    USize capacity;
+
+    // The number of bytes allocated for the components, including the index.
+    USize bytes;
+
+    // The fraction of the sparse index that doesn't map to a component.
+    F32 holeRatio;
+  };
+
+  // Subscribers to a single type of event.
+  struct EventStats {
+    // The ID of the event type, as returned by IdForType<EventType>::getId().
+    size_t eventId;
+
+    // The number of receivers subscribed to the event type.
+    USize subscriberCount;
+  };
+
+  // A snapshot of the memory used by the manager.  Collecting stats doesn't visit any entities or components, so it is
+  // cheap enough to do regularly.
+  struct Stats {
+    // The number of entity ID's handed out so far.
+    USize entitySlotCount;
+
+    // The number of entity slots the list of entities can hold without growing.
+    USize entitySlotCapacity;
+
+    // The number of entities that have not been removed.
+    USize liveEntityCount;
+
+    // The number of entity slots left empty by removed entities.
+    USize deadEntitySlotCount;
+
+    // The fraction of entity slots that are empty.
+    F32 entityHoleRatio;
+
+    // The number of bytes used by Entity objects and the list of entities, including its unused capacity.
+    USize entityBytes;
+
+    // The number of bytes used by all component storages.
+    USize componentBytes;
+
+    // The number of bytes used by the hierarchy, including the orders cached by propagate().
+    USize hierarchyBytes;
+
+    // The number of singletons that are set.
+    USize singletonCount;
+
+    // The number of heap allocations owned by the manager, not counting those owned by components themselves.
+    USize allocationCount;
+
+    // Stats for each component type that has a storage.
+    std::vector<ComponentStats> components;
+
+    // Stats for each event type that has been subscribed to or emitted.
+    std::vector<EventStats> events;
+  };
+
+  EntityManager() : m_emptyGroup(Entity::ComponentMask{}), m_liveEntityCount(0) {}
   ~EntityManager() {}
 
+  // Return a snapshot of the memory used by the manager.
+  Stats getStats() const;
+
   // Add a new entity to this manager and return the newly created entity.
   EntityId createEntity();
 
+  // Create the given number of entities with copies of all the components in the prefab.  The new entities have
+  // consecutive ID's and the ID of the first one is returned.
+  EntityId instantiate(const Prefab& prefab, USize count = 1);
+
+  // Create a new entity with copies of all the components of the entity with the given ID and return its ID.
+  // Components that are not copy constructible are not copied.
+  EntityId clone(EntityId id);
+
+  // Move count entities, with all their components, to the destination manager.  The ID's of the new entities in the
+  // destination are written to newIds, or kInvalidEntityId for entities that were already removed.  The entities are
+  // removed from this manager right away and their slots are freed on the next update().  Parent/child relationships
+  // are not moved.
+  void migrateEntities(const EntityId* ids, USize count, EntityManager* destination, EntityId* newIds);
+
   // Return a pointer to the entity with the given ID.
   Entity* getEntity(EntityId id);
 
+  // Return the number of entity ID's handed out so far, including the ID's of removed entities.
+  EntityId getEntitySlotCount() const {
+    return m_entities.getSize();
+  }
+
+  // Make the parent entity the parent of the child entity.  Pass kInvalidEntityId as the parent to detach the child
+  // from its current parent.  Both entities must exist.  When a parent is removed, its children become root entities.
+  // Returns false, without changing anything, if the relationship would create a cycle.
+  bool setParent(EntityId child, EntityId parent);
+
+  // Return the parent of the entity with the given ID or kInvalidEntityId if it doesn't have one.
+  EntityId getParent(EntityId id) const;
+
+  // Add a component to the entity with the given ID and return the newly created component.  If the entity already has
+  // a component of that type, it is replaced.  Components of the same type are packed together and moved around, so
+  // component types must be move constructible and move assignable.  The pointer is only valid until the next
+  // structural change to the storage for that type, which includes:
+  //
+  //   - Adding a component of that type to any entity.
+  //   - update() removing any entity with a component of that type.
+  //   - Adding a component of another type that completes an entity in a group that owns the type.
+  //   - Creating a group that owns the type.
+  //   - Sorting the components with sortComponents(), sortComponentsByKey() or sortComponentsByEntity().
+  //   - propagate() for that type.
+  //   - migrateEntities().
+  template <typename ComponentType, typename... Args>
+  ComponentType* addComponent(EntityId id, Args&&... args) {
+    Entity& entity = *m_entities[id];
+
+    // Create the component in the storage for its type.
+    detail::ComponentStorage<ComponentType>* storage = getStorage<ComponentType>();
+    ComponentType* component = storage->emplace(id, nu::forward<Args>(args)...);
+
+    // Set the component in the entity's mask.
+    entity.m_mask.set(detail::getComponentId<ComponentType>());
+
+    // If the storage is owned by a group, the entity might belong to the group now.
+    detail::GroupData* group = storage->getGroup();
+    if (group && entity.hasComponents(group->mask) && !group->contains(id)) {
+      group->add(id);
+
+      // Adding the entity to the group moved the component.
+      component = storage->get(id);
+    }
+
+    return component;
+  }
+
   // Return the component from the entity with the given ID.
   template <typename ComponentType>
   ComponentType* getComponent(EntityId id) const {
@@ -128,8 +309,90 @@ public:
     }
 #endif  // BUILD(DEBUG)
 
-    const Entity& entity = *m_entities[id];
-    return entity.getComponent<ComponentType>();
+    detail::ComponentStorage<ComponentType>* storage = findStorage<ComponentType>();
+    if (!storage) {
+      return nullptr;
+    }
+
+    return storage->get(id);
+  }
+
+  // Look up the components for count entities at once, storing a pointer to each in out, or null if the entity doesn't
+  // have the component.  This is faster than calling getComponent() for each entity, because the memory for entities
+  // further along is prefetched while we resolve the current one.
+  template <typename ComponentType>
+  void getComponents(const EntityId* ids, USize count, ComponentType** out) const {
+    detail::ComponentStorage<ComponentType>* storage = findStorage<ComponentType>();
+    if (!storage) {
+      std::fill(out, out + count, nullptr);
+      return;
+    }
+
+    storage->gather(ids, count, out);
+  }
+
+  // Copy the components for count entities into out.  Returns false if any of the entities doesn't have the component,
+  // in which case its slot in out is left unchanged.
+  template <typename ComponentType>
+  bool copyComponents(const EntityId* ids, USize count, ComponentType* out) const {
+    // Resolve the pointers in small batches, so that they stay on the stack.
+    constexpr USize kBatchSize = detail::kPrefetchDistance * 8;
+    ComponentType* components[kBatchSize];
+    bool result = true;
+
+    for (USize begin = 0; begin < count; begin += kBatchSize) {
+      USize batchSize = std::min(count - begin, kBatchSize);
+      getComponents(ids + begin, batchSize, components);
+
+      for (USize i = 0; i < batchSize; ++i) {
+        if (components[i]) {
+          out[begin + i] = *components[i];
+        } else {
+          result = false;
+        }
+      }
+    }
+
+    return result;
+  }
+
+  // Set the single, world global instance of SingletonType and return it.  Singletons are not attached to any entity and
+  // replace any existing instance of the same type.
+  template <typename SingletonType, typename... Args>
+  SingletonType* setSingleton(Args&&... args) {
+    using WrapperType = detail::SingletonWrapper<SingletonType>;
+
+    USize singletonId = detail::getSingletonId<SingletonType>();
+    if (singletonId >= m_singletons.size()) {
+      m_singletons.resize(singletonId + 1);
+    }
+
+    WrapperType* wrapper = new WrapperType{nu::forward<Args>(args)...};
+    m_singletons[singletonId].reset(wrapper);
+
+    return &wrapper->singleton;
+  }
+
+  // Return the instance of SingletonType or null if it was not set.
+  template <typename SingletonType>
+  SingletonType* getSingleton() const {
+    using WrapperType = detail::SingletonWrapper<SingletonType>;
+
+    USize singletonId = detail::getSingletonId<SingletonType>();
+    if (singletonId >= m_singletons.size() || !m_singletons[singletonId]) {
+      return nullptr;
+    }
+
+    return &static_cast<WrapperType*>(m_singletons[singletonId].get())->singleton;
+  }
+
+  // Destroy the instance of SingletonType, if it was set.
+  template <typename SingletonType>
+  void removeSingleton() {
+    USize singletonId = detail::getSingletonId<SingletonType>();
+    if (singletonId < m_singletons.size()) {
+      m_singletons[singletonId].reset();
+    }
   }
 
   // Return a view of all entities in the manager.
@@ -139,6 +402,160 @@ public:
     return EntitiesView{this, m_entities.getSize(), mask};
   }
 
+  // Call the function for each component of the given type, in the order they are stored, with a signature similar to:
+  //
+  //   void func(EntityId id, ComponentType& component);
+  template <typename ComponentType, typename Func>
+  void eachComponent(Func func) {
+    detail::ComponentStorage<ComponentType>* storage = getStorage<ComponentType>();
+
+    const EntityId* entityIds = storage->getEntityIds();
+    ComponentType* components = storage->getComponents();
+    for (USize i = 0; i < storage->getSize(); ++i) {
+      func(entityIds[i], components[i]);
+    }
+  }
+
+  // Sort the storage of the given component type in place, so that iterating it with eachComponent() visits the
+  // components in order.  The comparison function has a signature similar to:
+  //
+  //   bool compare(const ComponentType& left, const ComponentType& right);
+  //
+  // If the component type is owned by a group, the entities in the group are sorted among themselves and the other
+  // components in the group are moved in step.  Pointers to components of the type are invalidated.
+  template <typename ComponentType, typename Compare>
+  void sortComponents(Compare compare) {
+    detail::ComponentStorage<ComponentType>* storage = getStorage<ComponentType>();
+
+    USize begin = 0;
+    detail::GroupData* group = storage->getGroup();
+    if (group) {
+      storage->sort(0, group->size, compare, [group](USize left, USize right) { group->swapIndices(left, right); });
+      begin = group->size;
+    }
+
+    storage->sort(begin, storage->getSize(), compare,
+                  [storage](USize left, USize right) { storage->swapIndices(left, right); });
+  }
+
+  // Sort the storage of the given component type in place by the key returned from the key function, which has a
+  // signature similar to:
+  //
+  //   KeyType key(const ComponentType& component);
+  template <typename ComponentType, typename KeyFunc>
+  void sortComponentsByKey(KeyFunc keyFunc) {
+    sortComponents<ComponentType>(
+        [&keyFunc](const ComponentType& left, const ComponentType& right) { return keyFunc(left) < keyFunc(right); });
+  }
+
+  // Sort the storage of the given component type in place by the entities that own the components.  The comparison
+  // function has a signature similar to:
+  //
+  //   bool compare(EntityId left, EntityId right);
+  template <typename ComponentType, typename Compare>
+  void sortComponentsByEntity(Compare compare) {
+    detail::ComponentStorage<ComponentType>* storage = getStorage<ComponentType>();
+
+    USize begin = 0;
+    detail::GroupData* group = storage->getGroup();
+    if (group) {
+      storage->sortByEntity(0, group->size, compare,
+                            [group](USize left, USize right) { group->swapIndices(left, right); });
+      begin = group->size;
+    }
+
+    storage->sortByEntity(begin, storage->getSize(), compare,
+                          [storage](USize left, USize right) { storage->swapIndices(left, right); });
+  }
+
+  // Propagate values of the given component type down the hierarchy, e.g. to calculate world transforms from local
+  // ones.  The function has a signature similar to:
+  //
+  //   void func(const ComponentType* parent, ComponentType& component);
+  //
+  // Where parent is null for entities without a parent or of which the parent doesn't have the component.  The storage
+  // is kept sorted by depth in the hierarchy, so parents are always visited before their children in a single sweep
+  // over the packed components.  The order, with the index of each parent's component, is kept until the components or
+  // the hierarchy change, so propagating again doesn't look up any entities.
+  template <typename ComponentType, typename Func>
+  void propagate(Func func) {
+    detail::ComponentStorage<ComponentType>* storage = getStorage<ComponentType>();
+    detail::PropagationOrder& order = m_propagationOrders[detail::getComponentId<ComponentType>()];
+
+    // Only sort and rebuild the order if components were added, removed or moved or the hierarchy changed since the
+    // previous call.  Sorting is close to free if the hierarchy didn't change.  Components owned by a group are sorted
+    // within the group's range and the rest after it.
+    if (order.layoutVersion != storage->getLayoutVersion() || order.hierarchyVersion != m_hierarchy.getVersion()) {
+      sortComponentsByEntity<ComponentType>(
+          [this](EntityId left, EntityId right) { return m_hierarchy.getDepth(left) < m_hierarchy.getDepth(right); });
+      updatePropagationOrder(*storage, &order);
+    }
+
+    ComponentType* components = storage->getComponents();
+    for (USize i = 0; i < order.indices.size(); ++i) {
+      USize parentIndex = order.parentIndices[i];
+      func(parentIndex != detail::kInvalidComponentIndex ? &components[parentIndex] : nullptr,
+           components[order.indices[i]]);
+    }
+  }
+
+  // Keep a read only snapshot of all the components of the given type, as they were at the end of the last update().
+  // While systems that write the components work on the next tick, systems on other threads can read the snapshot
+  // with getSnapshotComponent() and eachSnapshotComponent().  No system may be running during update(), which is
+  // where the snapshot is replaced with a copy of the current components.
+  template <typename ComponentType>
+  void enableSnapshots() {
+    static_assert(std::is_copy_constructible<ComponentType>::value, "Snapshots require copy constructible components.");
+    getStorage<ComponentType>()->enableSnapshots();
+  }
+
+  // Return the component from the entity with the given ID in the snapshot, or null if the entity didn't have the
+  // component at the last update.
+  template <typename ComponentType>
+  const ComponentType* getSnapshotComponent(EntityId id) const {
+    detail::ComponentStorage<ComponentType>* storage = findStorage<ComponentType>();
+    if (!storage) {
+      return nullptr;
+    }
+
+    DCHECK(storage->areSnapshotsEnabled()) << "Snapshots are not enabled for the component.";
+    return storage->getSnapshot(id);
+  }
+
+  // Call the function for each component in the snapshot, with a signature similar to:
+  //
+  //   void func(EntityId id, const ComponentType& component);
+  template <typename ComponentType, typename Func>
+  void eachSnapshotComponent(Func func) const {
+    detail::ComponentStorage<ComponentType>* storage = findStorage<ComponentType>();
+    if (!storage) {
+      return;
+    }
+
+    DCHECK(storage->areSnapshotsEnabled()) << "Snapshots are not enabled for the component.";
+    storage->eachSnapshot(func);
+  }
+
+  // Return a group of all the entities that have all the specified components.  The group takes ownership of the
+  // storage of each of the component types, packing the entities in the group at the front of each storage in the same
+  // order.  A component type can only be owned by a single group.  If one of the component types is already owned by
+  // another group, an error is logged and the returned group is always empty.
+  template <typename... ComponentTypes>
+  Group<ComponentTypes...> group() {
+    Entity::ComponentMask mask = Entity::createMask<ComponentTypes...>();
+
+    // Create the group if it doesn't exist yet.
+    detail::GroupData* data = findGroup(mask);
+    if (!data) {
+      data = createGroup(mask, {getStorage<ComponentTypes>()...});
+      if (!data) {
+        data = &m_emptyGroup;
+      }
+    }
+
+    return Group<ComponentTypes...>{data, getStorage<ComponentTypes>()...};
+  }
+
   void update();
 
   // Subscribe the specified receiver to events of EventType.  The receiver must
@@ -167,6 +584,7 @@ public:
     // Connect a signal wrapper to the signal.
     signal->connect(detail::SignalWrapper<EventType>{
         std::bind(receiveFunc, receiver, std::placeholders::_1, std::placeholders::_2)});
+    ++m_subscriberCounts[IdForType<EventType>::getId()];
   }
 
   // Emit the given event with the parameters specified.
@@ -193,6 +611,54 @@ private:
 
   void cleanUpEntities();
 
+  // Replace the snapshots of all the storages that keep them.
+  void updateSnapshots();
+
+  // Remove all the components for the entity with the given ID from their storages.
+  void removeComponents(EntityId id);
+
+  // Add the entity with the given ID to all the groups it belongs to, but is not in yet.
+  void addToGroups(EntityId id);
+
+  // Return the group with the given mask, or null if there is no such group.
+  detail::GroupData* findGroup(const Entity::ComponentMask& mask);
+
+  // Rebuild the order in which propagate() visits the components in the storage, which must be sorted by depth.
+  void updatePropagationOrder(const detail::ComponentStorageBase& storage, detail::PropagationOrder* order);
+
+  // Create a new group with the given mask owning the given storages.  Returns null if any of the storages is already
+  // owned by another group.
+  detail::GroupData* createGroup(const Entity::ComponentMask& mask,
+                                 std::initializer_list<detail::ComponentStorageBase*> storages);
+
+  template <typename ComponentType>
+  // ComponentType: The type of the component we want the storage for.
+  detail::ComponentStorage<ComponentType>* findStorage() const {
+    ComponentId componentId = detail::getComponentId<ComponentType>();
+    if (componentId >= Entity::kMaxComponents) {
+      return nullptr;
+    }
+
+    return static_cast<detail::ComponentStorage<ComponentType>*>(m_storages[componentId].get());
+  }
+
+  template <typename ComponentType>
+  // ComponentType: The type of the component we want the storage for.
+  detail::ComponentStorage<ComponentType>* getStorage() {
+    using StorageType = detail::ComponentStorage<ComponentType>;
+
+    ComponentId componentId = detail::getComponentId<ComponentType>();
+    DCHECK(componentId < Entity::kMaxComponents) << "Too many component types.";
+
+    // Create the storage if it doesn't exist.
+    auto& storage = m_storages[componentId];
+    if (!storage) {
+      storage.reset(new StorageType);
+    }
+
+    return static_cast<StorageType*>(storage.get());
+  }
+
   template <typename EventType>
   // EventType: The type of the event we want the signal for.
   SignalType* getSignalFor() {
@@ -215,12 +681,46 @@ private:
   using EntitiesType = nu::DynamicArray<nu::ScopedPtr<Entity>>;
   EntitiesType m_entities;
 
+  // Storage for each type of component, indexed by component ID.
+  std::array<nu::ScopedPtr<detail::ComponentStorageBase>, Entity::kMaxComponents> m_storages;
+
+  // Parent/child relationships between entities.
+  detail::Hierarchy m_hierarchy;
+
+  // The order propagate() visits components in, indexed by component ID.
+  std::array<detail::PropagationOrder, Entity::kMaxComponents> m_propagationOrders;
+
+  // Singletons indexed by singleton ID.
+  std::vector<nu::ScopedPtr<detail::SingletonWrapperBase>> m_singletons;
+
+  // All the groups that own component storages.
+  nu::DynamicArray<nu::ScopedPtr<detail::GroupData>> m_groups;
+
+  // A group that owns no storages, for views of groups that couldn't be created.
+  detail::GroupData m_emptyGroup;
+
   // Signals that we use to emit events.
   std::unordered_map<size_t, std::unique_ptr<SignalType>> m_signals;
 
+  // The number of receivers subscribed to each signal.
+  std::unordered_map<size_t, USize> m_subscriberCounts;
+
+  // The number of entities that have not been removed.
+  USize m_liveEntityCount;
+
   DISALLOW_COPY_AND_ASSIGN(EntityManager);
 };
 
+template <typename ComponentType, typename... Args>
+inline ComponentType* Entity::addComponent(Args&&... args) {
+  return m_manager->addComponent<ComponentType>(m_id, nu::forward<Args>(args)...);
+}
+
+template <typename ComponentType>
+inline ComponentType* Entity::getComponent() const {
+  return m_manager->getComponent<ComponentType>(m_id);
+}
+
 }  // namespace ju
 
 #endif  // JUNCTIONS_ENTITY_MANAGER_H_
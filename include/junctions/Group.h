@@ -0,0 +1,99 @@
+
+#ifndef JUNCTIONS_GROUP_H_
+#define JUNCTIONS_GROUP_H_
+
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "junctions/ComponentStorage.h"
+#include "junctions/Entity.h"
+#include "nucleus/Types.h"
+
+namespace ju {
+
+namespace detail {
+
+// Book keeping for a group of component types.  Entities that have all the components in the group are packed at the
+// front of each member storage, in the same order.
+struct GroupData {
+  // The mask of all the components in the group.
+  Entity::ComponentMask mask;
+
+  // The storages of all the components in the group.
+  std::vector<ComponentStorageBase*> storages;
+
+  // The number of entities in the group.
+  USize size{0};
+
+  explicit GroupData(const Entity::ComponentMask& mask) : mask(mask) {}
+
+  // Returns true if the entity with the given ID is packed into the group.
+  bool contains(EntityId id) const;
+
+  // Move the entity with the given ID to the back of the group in each member storage.  The entity must have all the
+  // components in the group.
+  void add(EntityId id);
+
+  // Move the entity with the given ID out of the group in each member storage.
+  void remove(EntityId id);
+
+  // Swap the entities at the two indices in each member storage.
+  void swapIndices(USize left, USize right);
+};
+
+}  // namespace detail
+
+// A view over all the entities that have all the specified components.  The components are packed in parallel arrays,
+// so iterating a group doesn't have to look up any entities.
+template <typename... ComponentTypes>
+class Group {
+public:
+  Group(detail::GroupData* data, detail::ComponentStorage<ComponentTypes>*... storages)
+    : m_data(data), m_storages(storages...) {}
+
+  // Returns the number of entities in the group.
+  USize getSize() const {
+    return m_data->size;
+  }
+
+  // Returns the ID's of the entities in the group.
+  const EntityId* getEntityIds() const {
+    return std::get<0>(m_storages)->getEntityIds();
+  }
+
+  // Returns the packed components of the given type.  The first getSize() components belong to the group.
+  template <typename ComponentType>
+  ComponentType* getComponents() {
+    return std::get<detail::ComponentStorage<ComponentType>*>(m_storages)->getComponents();
+  }
+
+  // Call the function for each entity in the group with a signature similar to:
+  //
+  //   void func(EntityId id, ComponentTypes&... components);
+  template <typename Func>
+  void each(Func func) {
+    eachInternal(func, std::index_sequence_for<ComponentTypes...>{});
+  }
+
+private:
+  template <typename Func, USize... Indices>
+  void eachInternal(Func& func, std::index_sequence<Indices...>) {
+    const EntityId* entityIds = getEntityIds();
+    std::tuple<ComponentTypes*...> components{std::get<Indices>(m_storages)->getComponents()...};
+
+    for (USize i = 0; i < m_data->size; ++i) {
+      func(entityIds[i], std::get<Indices>(components)[i]...);
+    }
+  }
+
+  // The book keeping data shared by all views of this group.
+  detail::GroupData* m_data;
+
+  // The storages for each of the components in the group.
+  std::tuple<detail::ComponentStorage<ComponentTypes>*...> m_storages;
+};
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_GROUP_H_
@@ -0,0 +1,74 @@
+
+#ifndef JUNCTIONS_HIERARCHY_H_
+#define JUNCTIONS_HIERARCHY_H_
+
+#include <vector>
+
+#include "junctions/Entity.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Types.h"
+
+namespace ju {
+
+namespace detail {
+
+// Parent/child relationships between entities.  Each entity has at most one parent and the depth of every entity in the
+// hierarchy is cached, so that entities can be ordered with parents before their children.
+class Hierarchy {
+public:
+  Hierarchy();
+  ~Hierarchy();
+
+  // Returns the parent of the entity with the given ID, or kInvalidEntityId if it has no parent.
+  EntityId getParent(EntityId id) const {
+    return id < m_parents.size() ? m_parents[id] : kInvalidEntityId;
+  }
+
+  // Set the parent of the child entity.  Pass kInvalidEntityId as the parent to detach the child.  Returns false, without
+  // changing anything, if the child is the parent or one of its ancestors.
+  bool setParent(EntityId child, EntityId parent);
+
+  // Returns a number that changes whenever a relationship changes.
+  U64 getVersion() const {
+    return m_version;
+  }
+
+  // Returns the number of ancestors of the entity with the given ID.
+  USize getDepth(EntityId id);
+
+  // Returns the number of bytes allocated by the hierarchy.
+  USize getMemoryUsage() const;
+
+  // Returns the number of heap allocations owned by the hierarchy.
+  USize getAllocationCount() const;
+
+  // Remove all relationships of the entities with the given ID's.  Their children become root entities.
+  void removeEntities(const std::vector<EntityId>& ids);
+
+private:
+  // Recalculate the depth of every entity.
+  void updateDepths();
+
+  // Maps entity ID's to the ID of their parent.
+  std::vector<EntityId> m_parents;
+
+  // Maps entity ID's to the number of children they have.
+  std::vector<USize> m_childCounts;
+
+  // Maps entity ID's to their depth in the hierarchy.
+  std::vector<USize> m_depths;
+
+  // Set when the relationships changed since the depths were calculated.
+  bool m_depthsDirty;
+
+  // Incremented whenever a relationship changes.
+  U64 m_version;
+
+  DISALLOW_COPY_AND_ASSIGN(Hierarchy);
+};
+
+}  // namespace detail
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_HIERARCHY_H_
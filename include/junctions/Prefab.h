@@ -0,0 +1,103 @@
+
+#ifndef JUNCTIONS_PREFAB_H_
+#define JUNCTIONS_PREFAB_H_
+
+#include <array>
+
+#include "junctions/ComponentStorage.h"
+#include "junctions/Entity.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Memory/ScopedPtr.h"
+#include "nucleus/Utils/Move.h"
+
+namespace ju {
+
+namespace detail {
+
+struct ComponentPrototypeBase {
+  virtual ~ComponentPrototypeBase() {}
+
+  // Create an empty storage for the type of component.
+  virtual ComponentStorageBase* createStorage() const = 0;
+
+  // Insert a copy of the prototype into the storage for each of the entities.
+  virtual void copyInto(ComponentStorageBase* storage, const EntityId* entityIds, USize count) const = 0;
+};
+
+template <typename ComponentType>
+struct ComponentPrototype : public ComponentPrototypeBase {
+  ComponentType component;
+
+  template <typename... Args>
+  explicit ComponentPrototype(Args&&... args) : component(nu::forward<Args>(args)...) {}
+  ~ComponentPrototype() override {}
+
+  ComponentStorageBase* createStorage() const override {
+    return new ComponentStorage<ComponentType>;
+  }
+
+  void copyInto(ComponentStorageBase* storage, const EntityId* entityIds, USize count) const override {
+    static_cast<ComponentStorage<ComponentType>*>(storage)->insertCopies(entityIds, count, component);
+  }
+};
+
+}  // namespace detail
+
+// A template for creating entities.  A prefab holds a prototype value for each of its components, which is copied into
+// every entity instantiated from it with EntityManager::instantiate().
+class Prefab {
+public:
+  Prefab() = default;
+  ~Prefab() = default;
+
+  // Returns the component mask of the entities created from this prefab.
+  const Entity::ComponentMask& getMask() const {
+    return m_mask;
+  }
+
+  // Add the prototype for a component to the prefab.  The component type must be copy constructible.
+  template <typename ComponentType, typename... Args>
+  ComponentType* addComponent(Args&&... args) {
+    using PrototypeType = detail::ComponentPrototype<ComponentType>;
+
+    // Get the ID for the component.
+    ComponentId componentId = detail::getComponentId<ComponentType>();
+
+    PrototypeType* prototype = new PrototypeType{nu::forward<Args>(args)...};
+    m_prototypes[componentId].reset(prototype);
+
+    // Set the component in our mask.
+    m_mask.set(componentId);
+
+    return &prototype->component;
+  }
+
+  // Get the prototype for the specified component.  Returns null if the prefab doesn't have the specified type of
+  // component.
+  template <typename ComponentType>
+  ComponentType* getComponent() const {
+    using PrototypeType = detail::ComponentPrototype<ComponentType>;
+
+    const auto& prototype = m_prototypes[detail::getComponentId<ComponentType>()];
+    if (!prototype) {
+      return nullptr;
+    }
+
+    return &static_cast<PrototypeType*>(prototype.get())->component;
+  }
+
+private:
+  friend class EntityManager;
+
+  // The mask of all the components in the prefab.
+  Entity::ComponentMask m_mask;
+
+  // Map component type id's to prototypes.
+  std::array<nu::ScopedPtr<detail::ComponentPrototypeBase>, Entity::kMaxComponents> m_prototypes;
+
+  DISALLOW_COPY_AND_ASSIGN(Prefab);
+};
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_PREFAB_H_
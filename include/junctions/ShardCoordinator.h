@@ -0,0 +1,158 @@
+
+#ifndef JUNCTIONS_SHARD_COORDINATOR_H_
+#define JUNCTIONS_SHARD_COORDINATOR_H_
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "junctions/EntityManager.h"
+#include "junctions/SystemManager.h"
+#include "nucleus/Logging.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Types.h"
+
+namespace ju {
+
+class ShardCoordinator;
+
+// Emitted on the destination shard's entity manager for every entity that migrated to it.
+struct EntityMigrated {
+  // The index of the shard the entity came from.
+  USize sourceShard;
+
+  // The ID the entity had on the source shard.
+  EntityId sourceId;
+
+  // The ID of the entity on this shard.
+  EntityId entityId;
+
+  EntityMigrated(USize sourceShard, EntityId sourceId, EntityId entityId)
+    : sourceShard(sourceShard), sourceId(sourceId), entityId(entityId) {}
+};
+
+// A single world run by a ShardCoordinator, with its own entities and systems.  Everything in a shard is only touched
+// by the worker thread the shard runs on, so nothing in it needs to be locked.
+class Shard {
+public:
+  Shard(USize index, USize shardCount);
+  ~Shard();
+
+  // Returns the index of this shard in the coordinator.
+  USize getIndex() const {
+    return m_index;
+  }
+
+  EntityManager& getEntities() {
+    return m_entities;
+  }
+
+  SystemManager& getSystems() {
+    return m_systems;
+  }
+
+  // Queue the entity with the given ID, with all its components, to move to the destination shard at the end of the
+  // current update.  An EntityMigrated event is emitted on the destination with its new ID.
+  void migrate(EntityId id, USize destination);
+
+  // Queue an event to be emitted on the destination shard's entity manager at the end of the current update.
+  template <typename EventType, typename... Args>
+  void send(USize destination, Args&&... args) {
+    DCHECK(destination < m_migrations.size());
+
+    EventType event = EventType(std::forward<Args>(args)...);
+    m_events.push_back(
+        PendingEvent{destination, [event](EntityManager& entities) { entities.emit<EventType>(event); }});
+  }
+
+private:
+  friend class ShardCoordinator;
+
+  struct PendingEvent {
+    USize destination;
+    std::function<void(EntityManager&)> emit;
+  };
+
+  // The index of this shard in the coordinator.
+  USize m_index;
+
+  // The entities in this shard.
+  EntityManager m_entities;
+
+  // The systems that update the entities in this shard.
+  SystemManager m_systems;
+
+  // The ID's of entities to migrate, for each destination shard.
+  std::vector<std::vector<EntityId>> m_migrations;
+
+  // Events to send to other shards.
+  std::vector<PendingEvent> m_events;
+
+  DISALLOW_COPY_AND_ASSIGN(Shard);
+};
+
+// Runs a number of independent shards, each on its own worker thread.  Shards can only affect each other by migrating
+// entities and sending events, which are queued per shard and applied by the coordinator between updates, so no
+// global locks are needed.
+class ShardCoordinator {
+public:
+  using UpdateFunc = std::function<void(Shard&)>;
+
+  explicit ShardCoordinator(USize shardCount);
+  ~ShardCoordinator();
+
+  USize getShardCount() const {
+    return m_shards.size();
+  }
+
+  Shard& getShard(USize index) {
+    return *m_shards[index];
+  }
+
+  // Call the function for every shard on the shard's worker thread and wait for all of them to finish.  Then migrate
+  // all the queued entities and emit all the queued events on the calling thread.
+  void update(const UpdateFunc& func);
+
+private:
+  // The main loop of the worker thread for the shard with the given index.
+  void runWorker(USize index);
+
+  // Apply all the migrations and events queued by the shards.
+  void synchronize();
+
+  // All the shards.
+  std::vector<std::unique_ptr<Shard>> m_shards;
+
+  // A worker thread for each shard.
+  std::vector<std::thread> m_workers;
+
+  // Guards all the members below.
+  std::mutex m_mutex;
+
+  // Signalled when a new update starts or the workers should stop.
+  std::condition_variable m_updateStarted;
+
+  // Signalled when a worker finished its shard.
+  std::condition_variable m_shardFinished;
+
+  // The function the workers call for the current update.
+  const UpdateFunc* m_updateFunc;
+
+  // Incremented for every update, so that workers know when there is new work.
+  U64 m_updateCount;
+
+  // The number of shards that are not done with the current update.
+  USize m_pendingShardCount;
+
+  // Set when the workers should exit.
+  bool m_stopping;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(ShardCoordinator);
+};
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_SHARD_COORDINATOR_H_
@@ -0,0 +1,266 @@
+
+#ifndef JUNCTIONS_SPATIAL_INDEX_H_
+#define JUNCTIONS_SPATIAL_INDEX_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "junctions/EntityManager.h"
+#include "nucleus/Logging.h"
+#include "nucleus/Macros.h"
+#include "nucleus/Types.h"
+
+namespace ju {
+
+struct SpatialPoint {
+  F32 x;
+  F32 y;
+};
+
+// A uniform grid over the positions of all the entities with a PositionType component, for finding entities near a
+// point or in an area without visiting every entity.
+//
+// The index doesn't see changes to components as they happen.  Call update() once the positions changed, typically
+// once per frame after EntityManager::update().  Only entities that moved to another cell, were added or were removed
+// cause any work apart from reading the packed positions.
+template <typename PositionType>
+class SpatialIndex {
+public:
+  // Returns the position stored in the component.
+  using PositionFunc = SpatialPoint (*)(const PositionType& component);
+
+  // Create an index over the entities in the manager with cells of cellSize x cellSize.  Choose a cell size close to the
+  // typical query size.
+  SpatialIndex(EntityManager* entities, F32 cellSize, PositionFunc positionFunc)
+    : m_entities(entities), m_cellSize(cellSize), m_positionFunc(positionFunc), m_trackedCount(0), m_generation(0) {
+    DCHECK(cellSize > 0.f);
+  }
+
+  ~SpatialIndex() = default;
+
+  // Returns the number of entities in the index.
+  USize getSize() const {
+    return m_trackedCount;
+  }
+
+  // Bring the index up to date with the positions of all the entities with the component.
+  void update() {
+    ++m_generation;
+
+    USize seenCount = 0;
+    m_entities->eachComponent<PositionType>([this, &seenCount](EntityId id, PositionType& component) {
+      SpatialPoint position = m_positionFunc(component);
+      U64 key = getCellKey(position);
+
+      if (id >= m_records.size()) {
+        m_records.resize(id + 1);
+      }
+      Record& record = m_records[id];
+      record.generation = m_generation;
+      ++seenCount;
+
+      if (!record.cell) {
+        insert(id, key, position);
+        ++m_trackedCount;
+      } else if (record.key != key) {
+        erase(id);
+        insert(id, key, position);
+      } else {
+        (*record.cell)[record.slot].position = position;
+      }
+    });
+
+    // Remove the entities that don't have the component anymore.
+    if (seenCount == m_trackedCount) {
+      return;
+    }
+
+    for (EntityId id = 0; id < m_records.size(); ++id) {
+      Record& record = m_records[id];
+      if (record.cell && record.generation != m_generation) {
+        erase(id);
+        --m_trackedCount;
+      }
+    }
+  }
+
+  // Append the ID's of all entities with a position inside the box between min and max to out.
+  void queryBox(const SpatialPoint& min, const SpatialPoint& max, std::vector<EntityId>* out) const {
+    DCHECK(out);
+
+    forEachCell(min, max, [&](const Cell& cell) {
+      for (const Entry& entry : cell) {
+        if (entry.position.x >= min.x && entry.position.x <= max.x && entry.position.y >= min.y &&
+            entry.position.y <= max.y) {
+          out->push_back(entry.id);
+        }
+      }
+    });
+  }
+
+  // Append the ID's of all entities with a position inside the circle to out.  A negative radius finds nothing.
+  void queryRadius(const SpatialPoint& center, F32 radius, std::vector<EntityId>* out) const {
+    DCHECK(out);
+
+    // Squaring a negative radius would turn it into a valid one.
+    if (radius < 0.f) {
+      return;
+    }
+
+    SpatialPoint min{center.x - radius, center.y - radius};
+    SpatialPoint max{center.x + radius, center.y + radius};
+    F32 radiusSquared = radius * radius;
+
+    forEachCell(min, max, [&](const Cell& cell) {
+      for (const Entry& entry : cell) {
+        F32 dx = entry.position.x - center.x;
+        F32 dy = entry.position.y - center.y;
+        if (dx * dx + dy * dy <= radiusSquared) {
+          out->push_back(entry.id);
+        }
+      }
+    });
+  }
+
+  // Append the ID's of all entities of which the bounds might contain the point to out, given that no entity extends
+  // further than maxExtent from its position.  The caller tests the candidates against their actual bounds.  A negative
+  // extent finds nothing.
+  void queryPoint(const SpatialPoint& point, F32 maxExtent, std::vector<EntityId>* out) const {
+    if (maxExtent < 0.f) {
+      return;
+    }
+
+    queryBox(SpatialPoint{point.x - maxExtent, point.y - maxExtent},
+             SpatialPoint{point.x + maxExtent, point.y + maxExtent}, out);
+  }
+
+private:
+  struct Entry {
+    EntityId id;
+    SpatialPoint position;
+  };
+
+  using Cell = std::vector<Entry>;
+
+  struct Record {
+    // The cell the entity is in, or null if the entity is not in the index.
+    Cell* cell{nullptr};
+
+    // The key of the cell the entity is in.
+    U64 key{0};
+
+    // The index of the entity's entry in the cell.
+    USize slot{0};
+
+    // The last update the entity was seen in.
+    USize generation{0};
+  };
+
+  // Returns the cell coordinate for the value, clamped to the range of I32 so that huge and infinite values don't
+  // overflow the cast.  NaN is mapped to cell 0.
+  I32 getCellCoordinate(F32 value) const {
+    F64 cell = std::floor(static_cast<F64>(value) / m_cellSize);
+    if (std::isnan(cell)) {
+      return 0;
+    }
+    return static_cast<I32>(
+        std::max<F64>(std::numeric_limits<I32>::min(), std::min<F64>(std::numeric_limits<I32>::max(), cell)));
+  }
+
+  static U64 getCellKey(I32 x, I32 y) {
+    return (static_cast<U64>(static_cast<U32>(x)) << 32) | static_cast<U32>(y);
+  }
+
+  U64 getCellKey(const SpatialPoint& position) const {
+    return getCellKey(getCellCoordinate(position.x), getCellCoordinate(position.y));
+  }
+
+  void insert(EntityId id, U64 key, const SpatialPoint& position) {
+    Cell& cell = m_cells[key];
+
+    Record& record = m_records[id];
+    record.cell = &cell;
+    record.key = key;
+    record.slot = cell.size();
+
+    cell.push_back(Entry{id, position});
+  }
+
+  void erase(EntityId id) {
+    Record& record = m_records[id];
+    Cell& cell = *record.cell;
+
+    // Move the last entry in the cell into the hole.
+    cell[record.slot] = cell.back();
+    m_records[cell[record.slot].id].slot = record.slot;
+    cell.pop_back();
+
+    // Elements in an unordered_map don't move, so no records point at the cell we erase.
+    if (cell.empty()) {
+      m_cells.erase(record.key);
+    }
+
+    record.cell = nullptr;
+  }
+
+  // Call the function for each non empty cell that overlaps the box between min and max.
+  template <typename Func>
+  void forEachCell(const SpatialPoint& min, const SpatialPoint& max, Func func) const {
+    // The coordinates are I64 so that the loops below can't overflow at the edges of the I32 range.
+    I64 minX = getCellCoordinate(min.x);
+    I64 minY = getCellCoordinate(min.y);
+    I64 maxX = getCellCoordinate(max.x);
+    I64 maxY = getCellCoordinate(max.y);
+
+    // If the box covers more cells than there are occupied cells, it is cheaper to visit every occupied cell.  We can't
+    // tell which cells a box with NaN bounds covers, so those visit every occupied cell as well and leave it to the
+    // caller's tests to reject the entries.
+    F64 cellCount = (static_cast<F64>(maxX) - minX + 1) * (static_cast<F64>(maxY) - minY + 1);
+    if (cellCount > static_cast<F64>(m_cells.size()) || std::isnan(min.x) || std::isnan(min.y) ||
+        std::isnan(max.x) || std::isnan(max.y)) {
+      for (const auto& cell : m_cells) {
+        func(cell.second);
+      }
+      return;
+    }
+
+    for (I64 y = minY; y <= maxY; ++y) {
+      for (I64 x = minX; x <= maxX; ++x) {
+        auto it = m_cells.find(getCellKey(static_cast<I32>(x), static_cast<I32>(y)));
+        if (it != std::end(m_cells)) {
+          func(it->second);
+        }
+      }
+    }
+  }
+
+  // The entity manager with the entities we index.
+  EntityManager* m_entities;
+
+  // The width and height of each cell.
+  F32 m_cellSize;
+
+  // Function used to get the position from a component.
+  PositionFunc m_positionFunc;
+
+  // Occupied cells by cell key.
+  std::unordered_map<U64, Cell> m_cells;
+
+  // Where each entity is in the grid, indexed by entity ID.
+  std::vector<Record> m_records;
+
+  // The number of entities in the index.
+  USize m_trackedCount;
+
+  // Incremented on every update.
+  USize m_generation;
+
+  DISALLOW_COPY_AND_ASSIGN(SpatialIndex);
+};
+
+}  // namespace ju
+
+#endif  // JUNCTIONS_SPATIAL_INDEX_H_
@@ -0,0 +1,296 @@
+
+#include "junctions/Delta.h"
+
+#include "nucleus/MemoryDebug.h"
+
+namespace ju {
+
+// Layout of a delta, where all integers are LEB128 variable length encoded:
+//
+//   componentCount
+//   entityCount                      The number of entity ID's handed out by the source.
+//   destroyedCount
+//   destroyedCount x idDelta         Difference from the previous destroyed ID.
+//   recordCount
+//   recordCount x {
+//     idDelta                        Difference from the previous record's ID.
+//     componentMask                  A bit per replicated component in the record.
+//     for each bit in the mask {
+//       offset
+//       length
+//       length x byte                The changed range of the component's bytes.
+//     }
+//   }
+
+namespace {
+
+// The default limit on the number of entity ID's a decoder creates.
+constexpr EntityId kDefaultMaxEntityCount = 1u << 20;
+
+void writeVarint(std::vector<U8>* buffer, U64 value) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<U8>(value | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<U8>(value));
+}
+
+class DeltaReader {
+public:
+  DeltaReader(const U8* data, USize size) : m_current(data), m_end(data + size) {}
+
+  bool readVarint(U64* value) {
+    *value = 0;
+    for (U32 shift = 0; shift < 64; shift += 7) {
+      if (m_current == m_end) {
+        return false;
+      }
+
+      U8 byte = *m_current++;
+      *value |= static_cast<U64>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  const U8* readBytes(USize count) {
+    if (static_cast<USize>(m_end - m_current) < count) {
+      return nullptr;
+    }
+
+    const U8* bytes = m_current;
+    m_current += count;
+    return bytes;
+  }
+
+private:
+  const U8* m_current;
+  const U8* m_end;
+};
+
+}  // namespace
+
+DeltaEncoder::DeltaEncoder(EntityManager* entities) : m_entities(entities) {}
+
+DeltaEncoder::~DeltaEncoder() {}
+
+void DeltaEncoder::encode(std::vector<U8>* buffer) {
+  DCHECK(buffer);
+
+  EntityId entityCount = m_entities->getEntitySlotCount();
+  EntityId baselineCount = m_alive.size();
+
+  writeVarint(buffer, m_components.size());
+  writeVarint(buffer, entityCount);
+
+  // Grow the baseline for entities created since the previous encode.
+  if (entityCount > baselineCount) {
+    m_alive.resize(entityCount, false);
+    m_masks.resize(entityCount, 0);
+    for (Component& component : m_components) {
+      component.baseline.resize(entityCount * component.info.size, 0);
+    }
+  }
+
+  // Write all the entities that were alive, or created after, the previous encode and are gone now.
+  std::vector<EntityId> destroyedIds;
+  for (EntityId id = 0; id < entityCount; ++id) {
+    if (!m_entities->getEntity(id) && (id >= baselineCount || m_alive[id])) {
+      destroyedIds.push_back(id);
+      resetBaseline(id);
+    }
+  }
+
+  writeVarint(buffer, destroyedIds.size());
+  EntityId previousId = 0;
+  for (EntityId id : destroyedIds) {
+    writeVarint(buffer, id - previousId);
+    previousId = id;
+  }
+
+  // Write the changed components of every entity that is alive into a separate buffer, because we only know the number
+  // of records at the end.
+  std::vector<U8> records;
+  USize recordCount = 0;
+  previousId = 0;
+
+  struct ChangedRange {
+    const U8* bytes;
+    USize offset;
+    USize length;
+  };
+  ChangedRange changes[Entity::kMaxComponents];
+
+  for (EntityId id = 0; id < entityCount; ++id) {
+    if (!m_entities->getEntity(id)) {
+      continue;
+    }
+    m_alive[id] = true;
+
+    U32 changedMask = 0;
+    for (USize i = 0; i < m_components.size(); ++i) {
+      Component& component = m_components[i];
+      auto bytes = static_cast<const U8*>(component.info.getComponent(*m_entities, id));
+      if (!bytes) {
+        continue;
+      }
+
+      // Find the range of bytes that differ from the baseline.
+      U8* baseline = &component.baseline[id * component.info.size];
+      USize first = 0;
+      USize last = component.info.size;
+      while (first < last && bytes[first] == baseline[first]) {
+        ++first;
+      }
+      while (last > first && bytes[last - 1] == baseline[last - 1]) {
+        --last;
+      }
+
+      // New components are always written, even if they're all zeroes, so that the decoder adds them.
+      U32 bit = 1u << i;
+      if (first == last && (m_masks[id] & bit)) {
+        continue;
+      }
+
+      changedMask |= bit;
+      changes[i] = ChangedRange{bytes + first, first, last - first};
+      std::memcpy(baseline + first, bytes + first, last - first);
+    }
+
+    if (!changedMask) {
+      continue;
+    }
+
+    m_masks[id] |= changedMask;
+
+    writeVarint(&records, id - previousId);
+    writeVarint(&records, changedMask);
+    for (USize i = 0; i < m_components.size(); ++i) {
+      if (changedMask & (1u << i)) {
+        const ChangedRange& change = changes[i];
+        writeVarint(&records, change.offset);
+        writeVarint(&records, change.length);
+        records.insert(std::end(records), change.bytes, change.bytes + change.length);
+      }
+    }
+
+    previousId = id;
+    ++recordCount;
+  }
+
+  writeVarint(buffer, recordCount);
+  buffer->insert(std::end(*buffer), std::begin(records), std::end(records));
+}
+
+void DeltaEncoder::resetBaseline(EntityId id) {
+  m_alive[id] = false;
+  m_masks[id] = 0;
+  for (Component& component : m_components) {
+    std::memset(&component.baseline[id * component.info.size], 0, component.info.size);
+  }
+}
+
+DeltaDecoder::DeltaDecoder(EntityManager* entities)
+  : m_entities(entities), m_maxEntityCount(kDefaultMaxEntityCount) {}
+
+DeltaDecoder::~DeltaDecoder() {}
+
+bool DeltaDecoder::apply(const U8* data, USize size) {
+  DeltaReader reader{data, size};
+
+  U64 componentCount;
+  if (!reader.readVarint(&componentCount) || componentCount != m_components.size()) {
+    LOG(Error) << "Delta was encoded with different components.";
+    return false;
+  }
+
+  // Create all the new entities.  The source never hands out fewer ID's than before.  New entities without replicated
+  // components take up no space in the delta, so the number of new entities can only be bounded by an explicit limit.
+  U64 entityCount;
+  if (!reader.readVarint(&entityCount) || entityCount < m_entities->getEntitySlotCount()) {
+    return false;
+  }
+  if (entityCount > m_maxEntityCount) {
+    LOG(Error) << "Delta has more entities than the limit of " << m_maxEntityCount << ".";
+    return false;
+  }
+  while (m_entities->getEntitySlotCount() < entityCount) {
+    m_entities->createEntity();
+  }
+
+  // Remove all the destroyed entities.
+  U64 destroyedCount;
+  if (!reader.readVarint(&destroyedCount)) {
+    return false;
+  }
+
+  EntityId id = 0;
+  for (U64 i = 0; i < destroyedCount; ++i) {
+    U64 idDelta;
+    if (!reader.readVarint(&idDelta) || id + idDelta >= entityCount) {
+      return false;
+    }
+    id += idDelta;
+
+    Entity* entity = m_entities->getEntity(id);
+    if (entity) {
+      entity->remove();
+    }
+  }
+
+  // Patch all the changed components.
+  U64 recordCount;
+  if (!reader.readVarint(&recordCount)) {
+    return false;
+  }
+
+  id = 0;
+  for (U64 i = 0; i < recordCount; ++i) {
+    U64 idDelta;
+    U64 componentMask;
+    if (!reader.readVarint(&idDelta) || id + idDelta >= entityCount || !reader.readVarint(&componentMask) ||
+        componentMask >> m_components.size()) {
+      return false;
+    }
+    id += idDelta;
+
+    if (!m_entities->getEntity(id)) {
+      LOG(Error) << "Delta changes a removed entity.";
+      return false;
+    }
+
+    for (USize c = 0; c < m_components.size(); ++c) {
+      if (!(componentMask & (1u << c))) {
+        continue;
+      }
+
+      const detail::DeltaComponentInfo& info = m_components[c];
+      U64 offset;
+      U64 length;
+      if (!reader.readVarint(&offset) || !reader.readVarint(&length) || offset > info.size ||
+          length > info.size - offset) {
+        return false;
+      }
+
+      const U8* bytes = reader.readBytes(length);
+      if (!bytes) {
+        return false;
+      }
+
+      auto component = static_cast<U8*>(info.getOrAddComponent(*m_entities, id));
+      std::memcpy(component + offset, bytes, length);
+    }
+  }
+
+  // Clean up the removed entities.
+  if (destroyedCount) {
+    m_entities->update();
+  }
+
+  return true;
+}
+
+}  // namespace ju
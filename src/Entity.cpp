@@ -9,11 +9,6 @@ void Entity::resetInternal() {
   // Reset the ID to an invalid ID.
   m_id = kInvalidEntityId;
 
-  // Delete all the components.
-  for (auto& component : m_components) {
-    component.reset();
-  }
-
   // Reset the component mask.
   m_mask.reset();
 
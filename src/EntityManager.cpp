@@ -1,35 +1,351 @@
 
 #include "junctions/EntityManager.h"
 
+#include <vector>
+
 #include "nucleus/MemoryDebug.h"
 
 namespace ju {
 
+namespace {
+
+// Estimate the heap allocations of an unordered map: a node for each entry and the bucket array.
+template <typename MapType>
+USize getMapAllocationCount(const MapType& map) {
+  return map.size() + (map.empty() ? 0 : 1);
+}
+
+}  // namespace
+
 EntityManager::EntitiesView::EntitiesView(EntityManager* entityManager, size_t count, const Entity::ComponentMask& mask)
   : m_entityManager(entityManager), m_count(count), m_mask(mask) {}
 
 EntityId EntityManager::createEntity() {
   auto nextEntityId = m_entities.getSize();
-  m_entities.emplaceBack(new Entity{nextEntityId});
+  m_entities.emplaceBack(new Entity{this, nextEntityId});
+  ++m_liveEntityCount;
   return nextEntityId;
 }
 
+EntityId EntityManager::instantiate(const Prefab& prefab, USize count) {
+  if (count == 0) {
+    return kInvalidEntityId;
+  }
+
+  // Create all the entities up front, so that each storage can copy its components in one go.
+  std::vector<EntityId> entityIds(count);
+  for (USize i = 0; i < count; ++i) {
+    entityIds[i] = createEntity();
+    m_entities[entityIds[i]]->m_mask = prefab.m_mask;
+  }
+
+  for (ComponentId componentId = 0; componentId < Entity::kMaxComponents; ++componentId) {
+    const auto& prototype = prefab.m_prototypes[componentId];
+    if (!prototype) {
+      continue;
+    }
+
+    auto& storage = m_storages[componentId];
+    if (!storage) {
+      storage.reset(prototype->createStorage());
+    }
+    prototype->copyInto(storage.get(), entityIds.data(), count);
+  }
+
+  for (USize i = 0; i < count; ++i) {
+    addToGroups(entityIds[i]);
+  }
+
+  return entityIds[0];
+}
+
+EntityId EntityManager::clone(EntityId id) {
+  EntityId cloneId = createEntity();
+  Entity& entity = *m_entities[cloneId];
+
+  for (ComponentId componentId = 0; componentId < Entity::kMaxComponents; ++componentId) {
+    auto& storage = m_storages[componentId];
+    if (storage && storage->contains(id) && storage->copyComponent(id, cloneId)) {
+      entity.m_mask.set(componentId);
+    }
+  }
+
+  addToGroups(cloneId);
+
+  return cloneId;
+}
+
+void EntityManager::migrateEntities(const EntityId* ids, USize count, EntityManager* destination, EntityId* newIds) {
+  DCHECK(destination && destination != this);
+
+  // Create all the entities in the destination first, so we can move the components one type at a time.  Marking the
+  // entities for removal straight away skips any duplicate ID's.
+  for (USize i = 0; i < count; ++i) {
+    const auto& entity = m_entities[ids[i]];
+    if (!entity || entity->m_remove) {
+      newIds[i] = kInvalidEntityId;
+      continue;
+    }
+
+    newIds[i] = destination->createEntity();
+    destination->m_entities[newIds[i]]->m_mask = entity->m_mask;
+    entity->m_remove = true;
+  }
+
+  for (ComponentId componentId = 0; componentId < Entity::kMaxComponents; ++componentId) {
+    auto& storage = m_storages[componentId];
+    if (!storage) {
+      continue;
+    }
+
+    for (USize i = 0; i < count; ++i) {
+      if (newIds[i] == kInvalidEntityId || !storage->contains(ids[i])) {
+        continue;
+      }
+
+      auto& destinationStorage = destination->m_storages[componentId];
+      if (!destinationStorage) {
+        destinationStorage.reset(storage->createEmpty());
+      }
+      storage->moveComponentTo(ids[i], destinationStorage.get(), newIds[i]);
+    }
+  }
+
+  // Remove the moved from components, so that the entities don't show up in any queries until they are cleaned up.
+  for (USize i = 0; i < count; ++i) {
+    if (newIds[i] == kInvalidEntityId) {
+      continue;
+    }
+
+    destination->addToGroups(newIds[i]);
+
+    removeComponents(ids[i]);
+    m_entities[ids[i]]->m_mask.reset();
+  }
+}
+
 Entity* EntityManager::getEntity(EntityId id) {
   return m_entities[id].get();
 }
 
+bool EntityManager::setParent(EntityId child, EntityId parent) {
+  DCHECK(child < m_entities.getSize() && m_entities[child]) << "The child entity doesn't exist.";
+  DCHECK(parent == kInvalidEntityId || (parent < m_entities.getSize() && m_entities[parent]))
+      << "The parent entity doesn't exist.";
+
+  return m_hierarchy.setParent(child, parent);
+}
+
+EntityId EntityManager::getParent(EntityId id) const {
+  return m_hierarchy.getParent(id);
+}
+
+void EntityManager::updatePropagationOrder(const detail::ComponentStorageBase& storage,
+                                           detail::PropagationOrder* order) {
+  const detail::GroupData* group = storage.getGroup();
+  USize groupEnd = group ? group->size : 0;
+  USize size = storage.getSize();
+  const EntityId* entityIds = storage.getEntityIds();
+
+  order->indices.clear();
+  order->parentIndices.clear();
+  order->indices.reserve(size);
+  order->parentIndices.reserve(size);
+
+  // Walk the group's range and the rest at once, always taking the shallower entity next, so that parents are still
+  // visited before their children.
+  for (USize inGroup = 0, outsideGroup = groupEnd; inGroup < groupEnd || outsideGroup < size;) {
+    USize index;
+    if (outsideGroup == size || (inGroup < groupEnd && m_hierarchy.getDepth(entityIds[inGroup]) <=
+                                                           m_hierarchy.getDepth(entityIds[outsideGroup]))) {
+      index = inGroup++;
+    } else {
+      index = outsideGroup++;
+    }
+
+    EntityId parent = m_hierarchy.getParent(entityIds[index]);
+    order->indices.push_back(index);
+    order->parentIndices.push_back(parent != kInvalidEntityId && storage.contains(parent)
+                                       ? storage.indexOf(parent)
+                                       : detail::kInvalidComponentIndex);
+  }
+
+  order->layoutVersion = storage.getLayoutVersion();
+  order->hierarchyVersion = m_hierarchy.getVersion();
+}
+
+EntityManager::Stats EntityManager::getStats() const {
+  Stats stats;
+
+  stats.entitySlotCount = m_entities.getSize();
+  stats.entitySlotCapacity = m_entities.getCapacity();
+  stats.liveEntityCount = m_liveEntityCount;
+  stats.deadEntitySlotCount = stats.entitySlotCount - stats.liveEntityCount;
+  stats.entityHoleRatio =
+      stats.entitySlotCount ? static_cast<F32>(stats.deadEntitySlotCount) / stats.entitySlotCount : 0.f;
+  stats.entityBytes =
+      stats.entitySlotCapacity * sizeof(nu::ScopedPtr<Entity>) + stats.liveEntityCount * sizeof(Entity);
+
+  // One allocation for each live entity and one for the list of entities.
+  stats.allocationCount = stats.liveEntityCount + (stats.entitySlotCapacity ? 1 : 0);
+
+  stats.componentBytes = 0;
+  for (ComponentId componentId = 0; componentId < Entity::kMaxComponents; ++componentId) {
+    const auto& storage = m_storages[componentId];
+    if (!storage) {
+      continue;
+    }
+
+    ComponentStats componentStats;
+    componentStats.componentId = componentId;
+    componentStats.count = storage->getSize();
+    componentStats.capacity = storage->getCapacity();
+    componentStats.bytes = storage->getMemoryUsage();
+    componentStats.holeRatio =
+        storage->getSparseSize()
+            ? static_cast<F32>(storage->getSparseSize() - componentStats.count) / storage->getSparseSize()
+            : 0.f;
+    stats.components.push_back(componentStats);
+
+    stats.componentBytes += componentStats.bytes;
+
+    // The storage itself, plus its arrays and those of its snapshot.
+    stats.allocationCount += 1 + storage->getAllocationCount();
+  }
+
+  stats.hierarchyBytes = m_hierarchy.getMemoryUsage();
+  stats.allocationCount += m_hierarchy.getAllocationCount();
+  for (const detail::PropagationOrder& order : m_propagationOrders) {
+    stats.hierarchyBytes += (order.indices.capacity() + order.parentIndices.capacity()) * sizeof(USize);
+    stats.allocationCount += (order.indices.capacity() ? 1 : 0) + (order.parentIndices.capacity() ? 1 : 0);
+  }
+
+  stats.singletonCount = 0;
+  for (const auto& singleton : m_singletons) {
+    if (singleton) {
+      ++stats.singletonCount;
+    }
+  }
+  stats.allocationCount += stats.singletonCount + (m_singletons.capacity() ? 1 : 0);
+
+  // Each group, its list of storages and the list of groups.
+  for (decltype(m_groups)::SizeType i = 0; i < m_groups.getSize(); ++i) {
+    stats.allocationCount += 1 + (m_groups[i]->storages.capacity() ? 1 : 0);
+  }
+  stats.allocationCount += m_groups.getCapacity() ? 1 : 0;
+
+  for (const auto& signal : m_signals) {
+    auto it = m_subscriberCounts.find(signal.first);
+    stats.events.push_back(EventStats{signal.first, it != std::end(m_subscriberCounts) ? it->second : 0});
+  }
+  // Each signal and both maps.
+  stats.allocationCount +=
+      m_signals.size() + getMapAllocationCount(m_signals) + getMapAllocationCount(m_subscriberCounts);
+
+  return stats;
+}
+
 void EntityManager::update() {
   cleanUpEntities();
+  updateSnapshots();
 }
 
 void EntityManager::cleanUpEntities() {
+  std::vector<EntityId> removedIds;
+
   // Remove all entities that are marked for removal.
   for (EntitiesType::SizeType i = 0; i < m_entities.getSize(); ++i) {
     auto& entity = m_entities[i];
     if (entity && entity->m_remove) {
+      removedIds.push_back(entity->m_id);
+      removeComponents(entity->m_id);
       m_entities[i].reset();
+      --m_liveEntityCount;
     }
   }
+
+  // Detach the removed entities from the hierarchy.
+  if (!removedIds.empty()) {
+    m_hierarchy.removeEntities(removedIds);
+  }
+}
+
+void EntityManager::updateSnapshots() {
+  for (auto& storage : m_storages) {
+    if (storage && storage->areSnapshotsEnabled()) {
+      storage->updateSnapshot();
+    }
+  }
+}
+
+void EntityManager::removeComponents(EntityId id) {
+  // Move the entity out of any groups first, so that the groups stay packed.
+  for (decltype(m_groups)::SizeType i = 0; i < m_groups.getSize(); ++i) {
+    auto& group = m_groups[i];
+    if (group->contains(id)) {
+      group->remove(id);
+    }
+  }
+
+  for (auto& storage : m_storages) {
+    if (storage && storage->contains(id)) {
+      storage->remove(id);
+    }
+  }
+}
+
+void EntityManager::addToGroups(EntityId id) {
+  const Entity& entity = *m_entities[id];
+
+  for (decltype(m_groups)::SizeType i = 0; i < m_groups.getSize(); ++i) {
+    auto& group = m_groups[i];
+    if ((entity.getMask() & group->mask) == group->mask && !group->contains(id)) {
+      group->add(id);
+    }
+  }
+}
+
+detail::GroupData* EntityManager::findGroup(const Entity::ComponentMask& mask) {
+  for (decltype(m_groups)::SizeType i = 0; i < m_groups.getSize(); ++i) {
+    if (m_groups[i]->mask == mask) {
+      return m_groups[i].get();
+    }
+  }
+
+  return nullptr;
+}
+
+detail::GroupData* EntityManager::createGroup(const Entity::ComponentMask& mask,
+                                              std::initializer_list<detail::ComponentStorageBase*> storages) {
+  // Check all the storages before changing anything, because two groups that own the same storage would corrupt each
+  // other's packing.
+  for (detail::ComponentStorageBase* storage : storages) {
+    if (storage->getGroup()) {
+      LOG(Error) << "A component type can only be owned by one group.";
+      return nullptr;
+    }
+  }
+
+  detail::GroupData* group = new detail::GroupData{mask};
+  m_groups.emplaceBack(group);
+
+  // Take ownership of the storages.
+  for (detail::ComponentStorageBase* storage : storages) {
+    storage->setGroup(group);
+    group->storages.push_back(storage);
+  }
+
+  // Pack all the existing entities that have all the components into the group.  Entities before the current index
+  // that are not in the group are never swapped back past it, so we can walk the first storage in order.
+  detail::ComponentStorageBase* first = group->storages.front();
+  for (USize i = 0; i < first->getSize(); ++i) {
+    EntityId id = first->getEntityIds()[i];
+    if (m_entities[id]->hasComponents(mask)) {
+      group->add(id);
+    }
+  }
+
+  return group;
 }
 
 }  // namespace ju
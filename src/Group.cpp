@@ -0,0 +1,41 @@
+
+#include "junctions/Group.h"
+
+#include "nucleus/MemoryDebug.h"
+
+namespace ju {
+
+namespace detail {
+
+bool GroupData::contains(EntityId id) const {
+  ComponentStorageBase* storage = storages.front();
+  return storage->contains(id) && storage->indexOf(id) < size;
+}
+
+void GroupData::add(EntityId id) {
+  DCHECK(!contains(id));
+
+  for (ComponentStorageBase* storage : storages) {
+    storage->swapIndices(storage->indexOf(id), size);
+  }
+  ++size;
+}
+
+void GroupData::remove(EntityId id) {
+  DCHECK(contains(id));
+
+  --size;
+  for (ComponentStorageBase* storage : storages) {
+    storage->swapIndices(storage->indexOf(id), size);
+  }
+}
+
+void GroupData::swapIndices(USize left, USize right) {
+  for (ComponentStorageBase* storage : storages) {
+    storage->swapIndices(left, right);
+  }
+}
+
+}  // namespace detail
+
+}  // namespace ju
@@ -0,0 +1,143 @@
+
+#include "junctions/Hierarchy.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "nucleus/Logging.h"
+
+#include "nucleus/MemoryDebug.h"
+
+namespace ju {
+
+namespace detail {
+
+namespace {
+
+// Marks entities of which we haven't calculated the depth yet.
+constexpr USize kUnknownDepth = std::numeric_limits<USize>::max();
+
+}  // namespace
+
+Hierarchy::Hierarchy() : m_depthsDirty(false), m_version(0) {}
+
+Hierarchy::~Hierarchy() {}
+
+bool Hierarchy::setParent(EntityId child, EntityId parent) {
+  // A cycle would make updateDepths() walk up the hierarchy forever, so always refuse one.  Walking up the ancestors is
+  // cheap compared to everything else that happens when a parent changes.
+  for (EntityId ancestor = parent; ancestor != kInvalidEntityId; ancestor = getParent(ancestor)) {
+    if (ancestor == child) {
+      LOG(Error) << "An entity can't be the parent of itself or one of its ancestors.";
+      return false;
+    }
+  }
+
+  EntityId size = child + 1;
+  if (parent != kInvalidEntityId) {
+    size = std::max(size, parent + 1);
+  }
+  if (size > m_parents.size()) {
+    m_parents.resize(size, kInvalidEntityId);
+    m_childCounts.resize(size, 0);
+  }
+
+  EntityId& currentParent = m_parents[child];
+  if (currentParent != kInvalidEntityId) {
+    --m_childCounts[currentParent];
+  }
+
+  currentParent = parent;
+  if (parent != kInvalidEntityId) {
+    ++m_childCounts[parent];
+  }
+
+  m_depthsDirty = true;
+  ++m_version;
+
+  return true;
+}
+
+USize Hierarchy::getDepth(EntityId id) {
+  if (m_depthsDirty) {
+    updateDepths();
+  }
+
+  return id < m_depths.size() ? m_depths[id] : 0;
+}
+
+USize Hierarchy::getMemoryUsage() const {
+  return m_parents.capacity() * sizeof(EntityId) + m_childCounts.capacity() * sizeof(USize) +
+         m_depths.capacity() * sizeof(USize);
+}
+
+USize Hierarchy::getAllocationCount() const {
+  return (m_parents.capacity() ? 1 : 0) + (m_childCounts.capacity() ? 1 : 0) + (m_depths.capacity() ? 1 : 0);
+}
+
+void Hierarchy::removeEntities(const std::vector<EntityId>& ids) {
+  bool removedParents = false;
+
+  for (EntityId id : ids) {
+    if (id >= m_parents.size()) {
+      continue;
+    }
+
+    // Detach the entity from its parent.  The parent might have been removed already.
+    EntityId& parent = m_parents[id];
+    if (parent != kInvalidEntityId) {
+      if (m_childCounts[parent] != 0) {
+        --m_childCounts[parent];
+      }
+      parent = kInvalidEntityId;
+      m_depthsDirty = true;
+      ++m_version;
+    }
+
+    if (m_childCounts[id] != 0) {
+      m_childCounts[id] = 0;
+      removedParents = true;
+    }
+  }
+
+  if (!removedParents) {
+    return;
+  }
+
+  // Orphan the children of all the removed parents in one pass.  Removed entities have no children left.
+  for (EntityId& parent : m_parents) {
+    if (parent != kInvalidEntityId && m_childCounts[parent] == 0) {
+      parent = kInvalidEntityId;
+    }
+  }
+
+  m_depthsDirty = true;
+  ++m_version;
+}
+
+void Hierarchy::updateDepths() {
+  m_depths.assign(m_parents.size(), kUnknownDepth);
+
+  std::vector<EntityId> chain;
+  for (EntityId id = 0; id < m_parents.size(); ++id) {
+    // Walk up the hierarchy until we find an entity with a known depth.
+    EntityId current = id;
+    while (current != kInvalidEntityId && m_depths[current] == kUnknownDepth) {
+      chain.push_back(current);
+      current = m_parents[current];
+    }
+
+    // Fill in the depths on the way back down.
+    USize depth = current == kInvalidEntityId ? 0 : m_depths[current] + 1;
+    while (!chain.empty()) {
+      m_depths[chain.back()] = depth++;
+      chain.pop_back();
+    }
+  }
+
+  m_depthsDirty = false;
+}
+
+}  // namespace detail
+
+}  // namespace ju
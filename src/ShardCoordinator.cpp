@@ -0,0 +1,122 @@
+
+#include "junctions/ShardCoordinator.h"
+
+#include "nucleus/MemoryDebug.h"
+
+namespace ju {
+
+Shard::Shard(USize index, USize shardCount) : m_index(index), m_systems(&m_entities), m_migrations(shardCount) {}
+
+Shard::~Shard() {}
+
+void Shard::migrate(EntityId id, USize destination) {
+  DCHECK(destination < m_migrations.size());
+  DCHECK(destination != m_index) << "Can't migrate an entity to its own shard.";
+
+  m_migrations[destination].push_back(id);
+}
+
+ShardCoordinator::ShardCoordinator(USize shardCount)
+  : m_updateFunc(nullptr), m_updateCount(0), m_pendingShardCount(0), m_stopping(false) {
+  DCHECK(shardCount > 0);
+
+  for (USize i = 0; i < shardCount; ++i) {
+    m_shards.emplace_back(new Shard{i, shardCount});
+  }
+
+  for (USize i = 0; i < shardCount; ++i) {
+    m_workers.emplace_back(&ShardCoordinator::runWorker, this, i);
+  }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_updateStarted.notify_all();
+
+  for (std::thread& worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ShardCoordinator::update(const UpdateFunc& func) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_updateFunc = &func;
+    m_pendingShardCount = m_shards.size();
+    ++m_updateCount;
+    m_updateStarted.notify_all();
+
+    // Wait for all the shards to finish.
+    m_shardFinished.wait(lock, [this]() { return m_pendingShardCount == 0; });
+    m_updateFunc = nullptr;
+  }
+
+  synchronize();
+}
+
+void ShardCoordinator::runWorker(USize index) {
+  Shard& shard = *m_shards[index];
+  U64 lastUpdateCount = 0;
+
+  for (;;) {
+    const UpdateFunc* func;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_updateStarted.wait(lock, [this, lastUpdateCount]() { return m_stopping || m_updateCount != lastUpdateCount; });
+      if (m_stopping) {
+        return;
+      }
+
+      lastUpdateCount = m_updateCount;
+      func = m_updateFunc;
+    }
+
+    (*func)(shard);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_pendingShardCount;
+    }
+    m_shardFinished.notify_one();
+  }
+}
+
+void ShardCoordinator::synchronize() {
+  std::vector<EntityId> newIds;
+
+  // Migrate the entities in one batch for every pair of shards.
+  for (auto& source : m_shards) {
+    for (USize destinationIndex = 0; destinationIndex < m_shards.size(); ++destinationIndex) {
+      std::vector<EntityId>& ids = source->m_migrations[destinationIndex];
+      if (ids.empty()) {
+        continue;
+      }
+
+      EntityManager& destination = m_shards[destinationIndex]->m_entities;
+
+      newIds.resize(ids.size());
+      source->m_entities.migrateEntities(ids.data(), ids.size(), &destination, newIds.data());
+
+      for (USize i = 0; i < ids.size(); ++i) {
+        if (newIds[i] != kInvalidEntityId) {
+          destination.emit<EntityMigrated>(source->m_index, ids[i], newIds[i]);
+        }
+      }
+
+      ids.clear();
+    }
+  }
+
+  // Deliver the events sent between shards.
+  for (auto& source : m_shards) {
+    for (Shard::PendingEvent& event : source->m_events) {
+      event.emit(m_shards[event.destination]->m_entities);
+    }
+    source->m_events.clear();
+  }
+}
+
+}  // namespace ju
@@ -0,0 +1,156 @@
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "junctions/Delta.h"
+
+namespace ju {
+
+namespace {
+
+struct Position {
+  float x;
+  float y;
+};
+
+struct Health {
+  int current;
+  int maximum;
+};
+
+// Encode the changes in the source and apply them to the destination.  Returns the size of the delta.
+USize replicate(DeltaEncoder* encoder, DeltaDecoder* decoder) {
+  std::vector<U8> buffer;
+  encoder->encode(&buffer);
+  EXPECT_TRUE(decoder->apply(buffer.data(), buffer.size()));
+  return buffer.size();
+}
+
+}  // namespace
+
+TEST(DeltaTest, ReplicatesChanges) {
+  EntityManager source;
+  DeltaEncoder encoder{&source};
+  encoder.registerComponent<Position>();
+  encoder.registerComponent<Health>();
+
+  EntityManager destination;
+  DeltaDecoder decoder{&destination};
+  decoder.registerComponent<Position>();
+  decoder.registerComponent<Health>();
+
+  EntityId e1 = source.createEntity();
+  source.addComponent<Position>(e1, Position{1.f, 2.f});
+  EntityId e2 = source.createEntity();
+  source.addComponent<Position>(e2, Position{0.f, 0.f});
+  source.addComponent<Health>(e2, Health{100, 100});
+
+  replicate(&encoder, &decoder);
+  ASSERT_EQ(2u, destination.getEntitySlotCount());
+  EXPECT_EQ(2.f, destination.getComponent<Position>(e1)->y);
+  EXPECT_EQ(nullptr, destination.getComponent<Health>(e1));
+  ASSERT_NE(nullptr, destination.getComponent<Position>(e2));
+  EXPECT_EQ(100, destination.getComponent<Health>(e2)->maximum);
+
+  // Nothing changed, so the delta is only the header.
+  EXPECT_EQ(4u, replicate(&encoder, &decoder));
+
+  // Change a single field, add a component and remove an entity.
+  source.getComponent<Health>(e2)->current = 50;
+  source.addComponent<Health>(e1, Health{10, 10});
+  source.getEntity(e2)->remove();
+  source.update();
+  EntityId e3 = source.createEntity();
+  source.addComponent<Position>(e3, Position{3.f, 4.f});
+
+  replicate(&encoder, &decoder);
+  ASSERT_EQ(3u, destination.getEntitySlotCount());
+  EXPECT_EQ(10, destination.getComponent<Health>(e1)->current);
+  EXPECT_EQ(nullptr, destination.getEntity(e2));
+  EXPECT_EQ(4.f, destination.getComponent<Position>(e3)->y);
+}
+
+TEST(DeltaTest, RejectsMalformedDeltas) {
+  EntityManager destination;
+  DeltaDecoder decoder{&destination};
+  decoder.registerComponent<Position>();
+
+  // Wrong number of components.
+  std::vector<U8> delta{2, 0, 0, 0};
+  EXPECT_FALSE(decoder.apply(delta.data(), delta.size()));
+
+  // A change that writes past the end of the component.
+  delta = {1, 1, 0, 1, 0, 1, 4, 5, 1, 2, 3, 4, 5};
+  EXPECT_FALSE(decoder.apply(delta.data(), delta.size()));
+
+  // Truncated.
+  delta = {1, 1, 0, 1, 0, 1};
+  EXPECT_FALSE(decoder.apply(delta.data(), delta.size()));
+
+  // An entity count over the limit must be rejected before any entities are created.
+  EntityId slotCount = destination.getEntitySlotCount();
+  delta = {1, 0x80, 0x80, 0x80, 0x80, 0x10, 0, 0};
+  EXPECT_FALSE(decoder.apply(delta.data(), delta.size()));
+  EXPECT_EQ(slotCount, destination.getEntitySlotCount());
+
+  // The entity count can't go down.
+  delta = {1, static_cast<U8>(slotCount + 2), 0, 0};
+  EXPECT_TRUE(decoder.apply(delta.data(), delta.size()));
+  delta = {1, static_cast<U8>(slotCount + 1), 0, 0};
+  EXPECT_FALSE(decoder.apply(delta.data(), delta.size()));
+}
+
+TEST(DeltaTest, ReplicatesEntitiesWithoutComponents) {
+  EntityManager source;
+  DeltaEncoder encoder{&source};
+  encoder.registerComponent<Position>();
+
+  EntityManager destination;
+  DeltaDecoder decoder{&destination};
+  decoder.registerComponent<Position>();
+
+  // Entities that only have components that aren't replicated don't produce records, so the delta is smaller than
+  // the number of new entities.
+  for (int i = 0; i < 10; ++i) {
+    source.addComponent<Health>(source.createEntity(), Health{i, i});
+  }
+  EXPECT_GT(10u, replicate(&encoder, &decoder));
+  EXPECT_EQ(10u, destination.getEntitySlotCount());
+
+  // The limit is still applied.
+  decoder.setMaxEntityCount(12);
+  for (int i = 0; i < 3; ++i) {
+    source.createEntity();
+  }
+  std::vector<U8> buffer;
+  encoder.encode(&buffer);
+  EXPECT_FALSE(decoder.apply(buffer.data(), buffer.size()));
+  EXPECT_EQ(10u, destination.getEntitySlotCount());
+}
+
+TEST(DeltaTest, RegisterAfterEncode) {
+  EntityManager source;
+  DeltaEncoder encoder{&source};
+  encoder.registerComponent<Position>();
+
+  EntityManager destination;
+  DeltaDecoder decoder{&destination};
+  decoder.registerComponent<Position>();
+
+  EntityId e1 = source.createEntity();
+  source.addComponent<Position>(e1, Position{1.f, 2.f});
+  source.addComponent<Health>(e1, Health{5, 10});
+  replicate(&encoder, &decoder);
+  EXPECT_EQ(nullptr, destination.getComponent<Health>(e1));
+
+  // Components registered later are sent in full for existing entities.
+  encoder.registerComponent<Health>();
+  decoder.registerComponent<Health>();
+  replicate(&encoder, &decoder);
+  ASSERT_NE(nullptr, destination.getComponent<Health>(e1));
+  EXPECT_EQ(5, destination.getComponent<Health>(e1)->current);
+  EXPECT_EQ(10, destination.getComponent<Health>(e1)->maximum);
+}
+
+}  // namespace ju
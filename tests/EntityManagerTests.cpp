@@ -1,4 +1,8 @@
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "junctions/EntityManager.h"
@@ -18,6 +22,12 @@ struct AnotherComponent {
   int someValue{10};
 };
 
+struct MoveOnlyComponent {
+  std::unique_ptr<int> value;
+
+  MoveOnlyComponent() = default;
+};
+
 TEST(EntityManagerTest, Basic) {
 #if 0
   EntityManager em;
@@ -62,4 +72,333 @@ TEST(EntityManagerTest, Iteration) {
 #endif  // 0
 }
 
+TEST(EntityManagerTest, SortComponents) {
+  EntityManager em;
+
+  // Enough entities in reverse order to make the insertion sort give up.
+  std::vector<EntityId> ids;
+  for (int i = 0; i < 100; ++i) {
+    EntityId id = em.createEntity();
+    em.addComponent<MoveComponent>(id, 100 - i, i);
+    ids.push_back(id);
+  }
+
+  em.sortComponentsByKey<MoveComponent>([](const MoveComponent& component) { return component.x; });
+
+  int lastX = 0;
+  em.eachComponent<MoveComponent>([&](EntityId id, MoveComponent& component) {
+    EXPECT_LT(lastX, component.x);
+    EXPECT_EQ(&component, em.getComponent<MoveComponent>(id));
+    lastX = component.x;
+  });
+
+  // Nearly sorted components are handled by the insertion sort.
+  em.getComponent<MoveComponent>(ids[50])->x = 0;
+  em.sortComponents<MoveComponent>(
+      [](const MoveComponent& left, const MoveComponent& right) { return left.x < right.x; });
+  lastX = -1;
+  std::vector<EntityId> order;
+  em.eachComponent<MoveComponent>([&](EntityId id, MoveComponent& component) {
+    EXPECT_LT(lastX, component.x);
+    lastX = component.x;
+    order.push_back(id);
+  });
+  ASSERT_EQ(100u, order.size());
+  EXPECT_EQ(ids[50], order.front());
+}
+
+TEST(EntityManagerTest, SortGroupedComponents) {
+  EntityManager em;
+  auto group = em.group<MoveComponent, AnotherComponent>();
+
+  for (int i = 0; i < 10; ++i) {
+    EntityId id = em.createEntity();
+    em.addComponent<MoveComponent>(id, 10 - i, 0);
+    if (i % 2 == 0) {
+      em.addComponent<AnotherComponent>(id)->someValue = 10 - i;
+    }
+  }
+
+  em.sortComponentsByKey<MoveComponent>([](const MoveComponent& component) { return component.x; });
+
+  ASSERT_EQ(5u, group.getSize());
+  int lastX = 0;
+  group.each([&](EntityId id, MoveComponent& move, AnotherComponent& another) {
+    EXPECT_LT(lastX, move.x);
+    EXPECT_EQ(move.x, another.someValue);
+    lastX = move.x;
+  });
+}
+
+TEST(EntityManagerTest, InstantiatePrefab) {
+  EntityManager em;
+  auto group = em.group<MoveComponent, AnotherComponent>();
+
+  Prefab prefab;
+  prefab.addComponent<MoveComponent>(10, 20);
+  prefab.addComponent<AnotherComponent>()->someValue = 30;
+
+  EntityId first = em.instantiate(prefab, 100);
+  for (EntityId id = first; id < first + 100; ++id) {
+    Entity* entity = em.getEntity(id);
+    ASSERT_TRUE((entity->hasComponents<MoveComponent, AnotherComponent>()));
+    EXPECT_EQ(10, entity->getComponent<MoveComponent>()->x);
+    EXPECT_EQ(20, entity->getComponent<MoveComponent>()->y);
+    EXPECT_EQ(30, entity->getComponent<AnotherComponent>()->someValue);
+  }
+  EXPECT_EQ(100u, group.getSize());
+
+  EXPECT_EQ(kInvalidEntityId, em.instantiate(prefab, 0));
+}
+
+TEST(EntityManagerTest, CloneEntity) {
+  EntityManager em;
+
+  EntityId source = em.createEntity();
+  em.addComponent<MoveComponent>(source, 1, 2);
+  em.addComponent<MoveOnlyComponent>(source);
+
+  EntityId clone = em.clone(source);
+  EXPECT_NE(source, clone);
+
+  Entity* entity = em.getEntity(clone);
+  ASSERT_TRUE(entity->hasComponents<MoveComponent>());
+  EXPECT_FALSE(entity->hasComponents<MoveOnlyComponent>());
+  EXPECT_EQ(1, entity->getComponent<MoveComponent>()->x);
+  EXPECT_EQ(2, entity->getComponent<MoveComponent>()->y);
+  EXPECT_NE(em.getComponent<MoveComponent>(source), entity->getComponent<MoveComponent>());
+}
+
+TEST(EntityManagerTest, Singletons) {
+  EntityManager em;
+  EXPECT_EQ(nullptr, em.getSingleton<MoveComponent>());
+
+  MoveComponent* singleton = em.setSingleton<MoveComponent>(1, 2);
+  EXPECT_EQ(singleton, em.getSingleton<MoveComponent>());
+  EXPECT_EQ(1, em.getSingleton<MoveComponent>()->x);
+  EXPECT_EQ(nullptr, em.getSingleton<AnotherComponent>());
+
+  em.setSingleton<MoveComponent>(3, 4);
+  EXPECT_EQ(3, em.getSingleton<MoveComponent>()->x);
+
+  em.removeSingleton<MoveComponent>();
+  EXPECT_EQ(nullptr, em.getSingleton<MoveComponent>());
+}
+
+TEST(EntityManagerTest, PropagateDownHierarchy) {
+  EntityManager em;
+
+  // Create the children before their parents, so the storage starts out in the wrong order.
+  EntityId muzzle = em.createEntity();
+  em.addComponent<MoveComponent>(muzzle, 1, 0);
+  EntityId turret = em.createEntity();
+  em.addComponent<MoveComponent>(turret, 10, 0);
+  EntityId vehicle = em.createEntity();
+  em.addComponent<MoveComponent>(vehicle, 100, 0);
+
+  EXPECT_TRUE(em.setParent(turret, vehicle));
+  EXPECT_TRUE(em.setParent(muzzle, turret));
+  EXPECT_EQ(vehicle, em.getParent(turret));
+  EXPECT_EQ(kInvalidEntityId, em.getParent(vehicle));
+
+  // Relationships that would create a cycle are refused.
+  EXPECT_FALSE(em.setParent(vehicle, muzzle));
+  EXPECT_FALSE(em.setParent(vehicle, vehicle));
+  EXPECT_EQ(kInvalidEntityId, em.getParent(vehicle));
+
+  // Accumulate the positions down the hierarchy into y.
+  auto accumulate = [](const MoveComponent* parent, MoveComponent& component) {
+    component.y = component.x + (parent ? parent->y : 0);
+  };
+
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(100, em.getComponent<MoveComponent>(vehicle)->y);
+  EXPECT_EQ(110, em.getComponent<MoveComponent>(turret)->y);
+  EXPECT_EQ(111, em.getComponent<MoveComponent>(muzzle)->y);
+
+  // Removing the turret turns the muzzle into a root entity.
+  em.getEntity(turret)->remove();
+  em.update();
+  EXPECT_EQ(kInvalidEntityId, em.getParent(muzzle));
+
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(1, em.getComponent<MoveComponent>(muzzle)->y);
+}
+
+TEST(EntityManagerTest, PropagateAfterChanges) {
+  EntityManager em;
+
+  EntityId root = em.createEntity();
+  em.addComponent<MoveComponent>(root, 100, 0);
+  EntityId child = em.createEntity();
+  em.addComponent<MoveComponent>(child, 10, 0);
+  em.setParent(child, root);
+
+  auto accumulate = [](const MoveComponent* parent, MoveComponent& component) {
+    component.y = component.x + (parent ? parent->y : 0);
+  };
+
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(110, em.getComponent<MoveComponent>(child)->y);
+
+  // Changing the values reuses the order from the previous call.
+  em.getComponent<MoveComponent>(root)->x = 200;
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(210, em.getComponent<MoveComponent>(child)->y);
+
+  // Adding a component rebuilds the order.
+  EntityId grandchild = em.createEntity();
+  em.addComponent<MoveComponent>(grandchild, 1, 0);
+  em.setParent(grandchild, child);
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(211, em.getComponent<MoveComponent>(grandchild)->y);
+
+  // Moving the components around and changing the hierarchy both rebuild the order.
+  em.sortComponentsByKey<MoveComponent>([](const MoveComponent& component) { return component.x; });
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(211, em.getComponent<MoveComponent>(grandchild)->y);
+
+  em.setParent(grandchild, root);
+  em.propagate<MoveComponent>(accumulate);
+  EXPECT_EQ(201, em.getComponent<MoveComponent>(grandchild)->y);
+}
+
+TEST(EntityManagerTest, PropagateGroupedComponents) {
+  EntityManager em;
+  auto group = em.group<MoveComponent, AnotherComponent>();
+
+  // Parent and child end up on different sides of the group's range.
+  EntityId vehicle = em.createEntity();
+  em.addComponent<MoveComponent>(vehicle, 100, 0);
+  em.addComponent<AnotherComponent>(vehicle);
+  EntityId turret = em.createEntity();
+  em.addComponent<MoveComponent>(turret, 10, 0);
+  EntityId muzzle = em.createEntity();
+  em.addComponent<MoveComponent>(muzzle, 1, 0);
+  em.addComponent<AnotherComponent>(muzzle);
+
+  em.setParent(muzzle, turret);
+  em.setParent(turret, vehicle);
+  ASSERT_EQ(2u, group.getSize());
+
+  em.propagate<MoveComponent>([](const MoveComponent* parent, MoveComponent& component) {
+    component.y = component.x + (parent ? parent->y : 0);
+  });
+  EXPECT_EQ(100, em.getComponent<MoveComponent>(vehicle)->y);
+  EXPECT_EQ(110, em.getComponent<MoveComponent>(turret)->y);
+  EXPECT_EQ(111, em.getComponent<MoveComponent>(muzzle)->y);
+
+  // The group is still packed in lockstep.
+  group.each([&em](EntityId id, MoveComponent& move, AnotherComponent&) {
+    EXPECT_EQ(em.getComponent<MoveComponent>(id), &move);
+  });
+}
+
+struct StatsEvent {};
+
+struct StatsReceiver {
+  void receive(EntityManager&, const StatsEvent&) {}
+};
+
+TEST(EntityManagerTest, Stats) {
+  EntityManager em;
+
+  for (int i = 0; i < 4; ++i) {
+    em.addComponent<MoveComponent>(em.createEntity(), i, i);
+  }
+  em.getEntity(1)->remove();
+  em.update();
+
+  StatsReceiver receiver1;
+  StatsReceiver receiver2;
+  em.subscribe<StatsEvent>(&receiver1);
+  em.subscribe<StatsEvent>(&receiver2);
+
+  EntityManager::Stats stats = em.getStats();
+  EXPECT_EQ(4u, stats.entitySlotCount);
+  EXPECT_LE(4u, stats.entitySlotCapacity);
+  EXPECT_LE(stats.entitySlotCapacity * sizeof(void*), stats.entityBytes);
+  EXPECT_EQ(3u, stats.liveEntityCount);
+  EXPECT_EQ(1u, stats.deadEntitySlotCount);
+  EXPECT_FLOAT_EQ(0.25f, stats.entityHoleRatio);
+
+  ASSERT_EQ(1u, stats.components.size());
+  EXPECT_EQ(3u, stats.components[0].count);
+  EXPECT_LE(3 * sizeof(MoveComponent), stats.components[0].bytes);
+  EXPECT_FLOAT_EQ(0.25f, stats.components[0].holeRatio);
+  EXPECT_EQ(stats.components[0].bytes, stats.componentBytes);
+
+  ASSERT_EQ(1u, stats.events.size());
+  EXPECT_EQ(IdForType<StatsEvent>::getId(), stats.events[0].eventId);
+  EXPECT_EQ(2u, stats.events[0].subscriberCount);
+
+  // A snapshot adds the copies of the component, entity ID and sparse arrays.
+  em.enableSnapshots<MoveComponent>();
+  EXPECT_EQ(stats.allocationCount + 3, em.getStats().allocationCount);
+}
+
+TEST(EntityManagerTest, BatchedLookups) {
+  EntityManager em;
+
+  std::vector<EntityId> ids;
+  for (int i = 0; i < 100; ++i) {
+    EntityId id = em.createEntity();
+    if (i != 42) {
+      em.addComponent<MoveComponent>(id, i, -i);
+    }
+    ids.push_back(id);
+  }
+  std::reverse(std::begin(ids), std::end(ids));
+
+  std::vector<MoveComponent*> pointers(ids.size());
+  em.getComponents(ids.data(), ids.size(), pointers.data());
+  for (USize i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(em.getComponent<MoveComponent>(ids[i]), pointers[i]);
+  }
+
+  std::vector<MoveComponent> values(ids.size());
+  EXPECT_FALSE(em.copyComponents(ids.data(), ids.size(), values.data()));
+  EXPECT_EQ(99, values[0].x);
+  EXPECT_EQ(0, values[99].x);
+
+  ids.erase(std::begin(ids) + 57);
+  EXPECT_TRUE(em.copyComponents(ids.data(), ids.size(), values.data()));
+
+  std::vector<AnotherComponent*> missing(ids.size(), nullptr);
+  em.getComponents(ids.data(), ids.size(), missing.data());
+  EXPECT_EQ(nullptr, missing[0]);
+}
+
+TEST(EntityManagerTest, Snapshots) {
+  EntityManager em;
+
+  EntityId e1 = em.createEntity();
+  em.addComponent<MoveComponent>(e1, 1, 1);
+  em.enableSnapshots<MoveComponent>();
+  EXPECT_EQ(1, em.getSnapshotComponent<MoveComponent>(e1)->x);
+
+  // Changes are not visible in the snapshot until the next update.
+  em.getComponent<MoveComponent>(e1)->x = 2;
+  EntityId e2 = em.createEntity();
+  em.addComponent<MoveComponent>(e2, 3, 3);
+  EXPECT_EQ(1, em.getSnapshotComponent<MoveComponent>(e1)->x);
+  EXPECT_EQ(nullptr, em.getSnapshotComponent<MoveComponent>(e2));
+
+  em.update();
+  EXPECT_EQ(2, em.getSnapshotComponent<MoveComponent>(e1)->x);
+  EXPECT_EQ(3, em.getSnapshotComponent<MoveComponent>(e2)->x);
+
+  // Removed entities stay in the snapshot until the update that removes them.
+  em.getEntity(e1)->remove();
+  int count = 0;
+  em.eachSnapshotComponent<MoveComponent>([&count](EntityId, const MoveComponent&) { ++count; });
+  EXPECT_EQ(2, count);
+
+  em.update();
+  EXPECT_EQ(nullptr, em.getSnapshotComponent<MoveComponent>(e1));
+  count = 0;
+  em.eachSnapshotComponent<MoveComponent>([&count](EntityId, const MoveComponent&) { ++count; });
+  EXPECT_EQ(1, count);
+}
+
 }  // namespace ju
@@ -0,0 +1,97 @@
+
+#include "gtest/gtest.h"
+
+#include "junctions/EntityManager.h"
+
+namespace ju {
+
+namespace {
+
+struct Position {
+  int x{0};
+  int y{0};
+
+  Position(int x, int y) : x(x), y(y) {}
+};
+
+struct Velocity {
+  int dx{0};
+  int dy{0};
+
+  Velocity(int dx, int dy) : dx(dx), dy(dy) {}
+};
+
+struct Health {
+  int current{0};
+};
+
+}  // namespace
+
+TEST(GroupTest, PacksExistingEntities) {
+  EntityManager em;
+
+  EntityId e1 = em.createEntity();
+  em.addComponent<Position>(e1, 1, 1);
+
+  EntityId e2 = em.createEntity();
+  em.addComponent<Position>(e2, 2, 2);
+  em.addComponent<Velocity>(e2, 20, 20);
+
+  auto group = em.group<Position, Velocity>();
+  ASSERT_EQ(1u, group.getSize());
+  EXPECT_EQ(e2, group.getEntityIds()[0]);
+  EXPECT_EQ(2, group.getComponents<Position>()[0].x);
+  EXPECT_EQ(20, group.getComponents<Velocity>()[0].dx);
+}
+
+TEST(GroupTest, TracksAddedAndRemovedEntities) {
+  EntityManager em;
+  auto group = em.group<Position, Velocity>();
+
+  EntityId ids[4];
+  for (int i = 0; i < 4; ++i) {
+    ids[i] = em.createEntity();
+    em.getEntity(ids[i])->addComponent<Position>(i, i);
+  }
+
+  em.addComponent<Velocity>(ids[3], 30, 30);
+  em.addComponent<Velocity>(ids[1], 10, 10);
+  ASSERT_EQ(2u, group.getSize());
+
+  // Components are in lockstep for every entity in the group.
+  group.each([&em](EntityId id, Position& position, Velocity& velocity) {
+    EXPECT_EQ(em.getComponent<Position>(id), &position);
+    EXPECT_EQ(position.x * 10, velocity.dx);
+  });
+
+  em.getEntity(ids[3])->remove();
+  em.update();
+  ASSERT_EQ(1u, group.getSize());
+  EXPECT_EQ(ids[1], group.getEntityIds()[0]);
+  EXPECT_EQ(1, group.getComponents<Position>()[0].x);
+  EXPECT_EQ(10, group.getComponents<Velocity>()[0].dx);
+}
+
+TEST(GroupTest, RejectsOverlappingGroups) {
+  EntityManager em;
+  auto group = em.group<Position, Velocity>();
+
+  EntityId ids[3];
+  for (int i = 0; i < 3; ++i) {
+    ids[i] = em.createEntity();
+    em.addComponent<Position>(ids[i], i, i);
+    em.addComponent<Health>(ids[i]);
+  }
+  em.addComponent<Velocity>(ids[2], 20, 20);
+
+  // Position is already owned, so the second group is empty and leaves the first one alone.
+  auto overlapping = em.group<Position, Health>();
+  EXPECT_EQ(0u, overlapping.getSize());
+
+  ASSERT_EQ(1u, group.getSize());
+  EXPECT_EQ(ids[2], group.getEntityIds()[0]);
+  EXPECT_EQ(2, group.getComponents<Position>()[0].x);
+  EXPECT_EQ(20, group.getComponents<Velocity>()[0].dx);
+}
+
+}  // namespace ju
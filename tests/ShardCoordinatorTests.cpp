@@ -0,0 +1,133 @@
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "junctions/ShardCoordinator.h"
+
+namespace ju {
+
+namespace {
+
+struct Cargo {
+  int weight;
+
+  explicit Cargo(int weight) : weight(weight) {}
+};
+
+struct Greeting {
+  USize from;
+
+  explicit Greeting(USize from) : from(from) {}
+};
+
+struct Receiver {
+  std::vector<EntityMigrated> migrated;
+  std::vector<USize> greetings;
+
+  void receive(EntityManager&, const EntityMigrated& event) {
+    migrated.push_back(event);
+  }
+
+  void receive(EntityManager&, const Greeting& event) {
+    greetings.push_back(event.from);
+  }
+};
+
+template <int Index>
+struct UniqueType {};
+
+using IdGetter = USize (*)();
+
+template <int... Indices>
+std::vector<IdGetter> createSingletonIdGetters(std::integer_sequence<int, Indices...>) {
+  return {&detail::getSingletonId<UniqueType<Indices>>...};
+}
+
+}  // namespace
+
+// Component and singleton ID's are handed out by the same kind of counter.  We probe with singletons, because there can
+// only be Entity::kMaxComponents component types in the whole process.
+TEST(ShardCoordinatorTest, TypeIdsAreUniqueAcrossThreads) {
+  constexpr int kTypeCount = 16;
+  std::vector<IdGetter> getters = createSingletonIdGetters(std::make_integer_sequence<int, kTypeCount>{});
+
+  // Every thread uses a different type for the first time, all at once.
+  std::atomic<bool> start{false};
+  std::vector<USize> ids(kTypeCount);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kTypeCount; ++i) {
+    threads.emplace_back([&, i]() {
+      while (!start) {
+      }
+      ids[i] = getters[i]();
+    });
+  }
+  start = true;
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::sort(std::begin(ids), std::end(ids));
+  EXPECT_EQ(std::end(ids), std::adjacent_find(std::begin(ids), std::end(ids)));
+}
+
+TEST(ShardCoordinatorTest, RunsShardsOnWorkers) {
+  ShardCoordinator coordinator{4};
+  ASSERT_EQ(4u, coordinator.getShardCount());
+
+  std::thread::id mainThread = std::this_thread::get_id();
+  std::atomic<int> updated{0};
+
+  for (int i = 0; i < 3; ++i) {
+    coordinator.update([&](Shard& shard) {
+      EXPECT_NE(mainThread, std::this_thread::get_id());
+      shard.getEntities().createEntity();
+      ++updated;
+    });
+  }
+
+  EXPECT_EQ(12, updated.load());
+  for (USize i = 0; i < coordinator.getShardCount(); ++i) {
+    EXPECT_EQ(3u, coordinator.getShard(i).getEntities().getEntitySlotCount());
+  }
+}
+
+TEST(ShardCoordinatorTest, MigratesEntitiesAndSendsEvents) {
+  ShardCoordinator coordinator{2};
+
+  EntityManager& source = coordinator.getShard(0).getEntities();
+  EntityId e1 = source.createEntity();
+  source.addComponent<Cargo>(e1, 10);
+  EntityId e2 = source.createEntity();
+  source.addComponent<Cargo>(e2, 20);
+
+  Receiver receiver;
+  coordinator.getShard(1).getEntities().subscribe<EntityMigrated>(&receiver);
+  coordinator.getShard(1).getEntities().subscribe<Greeting>(&receiver);
+
+  coordinator.update([&](Shard& shard) {
+    if (shard.getIndex() == 0) {
+      shard.migrate(e2, 1);
+      shard.send<Greeting>(1, shard.getIndex());
+    }
+  });
+
+  // The migrated entity is gone from the source right away.
+  EXPECT_EQ(nullptr, source.getComponent<Cargo>(e2));
+  EXPECT_EQ(10, source.getComponent<Cargo>(e1)->weight);
+
+  ASSERT_EQ(1u, receiver.migrated.size());
+  EXPECT_EQ(0u, receiver.migrated[0].sourceShard);
+  EXPECT_EQ(e2, receiver.migrated[0].sourceId);
+  EntityManager& destination = coordinator.getShard(1).getEntities();
+  EXPECT_EQ(20, destination.getComponent<Cargo>(receiver.migrated[0].entityId)->weight);
+
+  EXPECT_EQ(std::vector<USize>{0}, receiver.greetings);
+}
+
+}  // namespace ju
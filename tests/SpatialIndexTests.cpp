@@ -0,0 +1,132 @@
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "junctions/SpatialIndex.h"
+
+namespace ju {
+
+namespace {
+
+struct Position {
+  F32 x;
+  F32 y;
+
+  Position(F32 x, F32 y) : x(x), y(y) {}
+};
+
+SpatialPoint getPosition(const Position& position) {
+  return SpatialPoint{position.x, position.y};
+}
+
+std::vector<EntityId> sorted(std::vector<EntityId> ids) {
+  std::sort(std::begin(ids), std::end(ids));
+  return ids;
+}
+
+}  // namespace
+
+TEST(SpatialIndexTest, Queries) {
+  EntityManager em;
+  SpatialIndex<Position> index{&em, 10.f, &getPosition};
+
+  // A grid of entities 5 units apart, centered on the origin.
+  for (int y = -10; y <= 10; ++y) {
+    for (int x = -10; x <= 10; ++x) {
+      em.addComponent<Position>(em.createEntity(), x * 5.f, y * 5.f);
+    }
+  }
+  index.update();
+  EXPECT_EQ(21u * 21u, index.getSize());
+
+  std::vector<EntityId> result;
+  index.queryRadius(SpatialPoint{0.f, 0.f}, 5.f, &result);
+  EXPECT_EQ(5u, result.size());
+
+  result.clear();
+  index.queryBox(SpatialPoint{-12.f, -2.f}, SpatialPoint{12.f, 2.f}, &result);
+  EXPECT_EQ(5u, result.size());
+
+  result.clear();
+  index.queryPoint(SpatialPoint{1.f, 1.f}, 1.f, &result);
+  ASSERT_EQ(1u, result.size());
+  EXPECT_EQ(0.f, em.getComponent<Position>(result[0])->x);
+
+  // Covers every cell, so all the occupied cells are visited.
+  result.clear();
+  index.queryBox(SpatialPoint{-1000.f, -1000.f}, SpatialPoint{1000.f, 1000.f}, &result);
+  EXPECT_EQ(21u * 21u, result.size());
+
+  // Extents beyond the range of cell coordinates are clamped, so they still find everything.
+  result.clear();
+  index.queryRadius(SpatialPoint{0.f, 0.f}, INFINITY, &result);
+  EXPECT_EQ(21u * 21u, result.size());
+
+  result.clear();
+  index.queryBox(SpatialPoint{-1e20f, -1e20f}, SpatialPoint{1e20f, 1e20f}, &result);
+  EXPECT_EQ(21u * 21u, result.size());
+
+  result.clear();
+  index.queryBox(SpatialPoint{-1e20f, -1e20f}, SpatialPoint{-1e19f, -1e19f}, &result);
+  EXPECT_TRUE(result.empty());
+
+  result.clear();
+  index.queryBox(SpatialPoint{NAN, 0.f}, SpatialPoint{10.f, 10.f}, &result);
+  EXPECT_TRUE(result.empty());
+
+  // Negative sizes find nothing.
+  result.clear();
+  index.queryRadius(SpatialPoint{0.f, 0.f}, -5.f, &result);
+  EXPECT_TRUE(result.empty());
+
+  result.clear();
+  index.queryPoint(SpatialPoint{0.f, 0.f}, -1.f, &result);
+  EXPECT_TRUE(result.empty());
+}
+
+TEST(SpatialIndexTest, TracksChanges) {
+  EntityManager em;
+  SpatialIndex<Position> index{&em, 10.f, &getPosition};
+
+  EntityId e1 = em.createEntity();
+  em.addComponent<Position>(e1, 0.f, 0.f);
+  EntityId e2 = em.createEntity();
+  em.addComponent<Position>(e2, 1.f, 1.f);
+  index.update();
+
+  std::vector<EntityId> result;
+  index.queryRadius(SpatialPoint{0.f, 0.f}, 2.f, &result);
+  EXPECT_EQ(sorted({e1, e2}), sorted(result));
+
+  // Move one entity to another cell and the other inside its cell.
+  em.getComponent<Position>(e1)->x = 100.f;
+  em.getComponent<Position>(e2)->x = 3.f;
+  index.update();
+
+  result.clear();
+  index.queryRadius(SpatialPoint{0.f, 0.f}, 2.f, &result);
+  EXPECT_TRUE(result.empty());
+
+  result.clear();
+  index.queryRadius(SpatialPoint{100.f, 0.f}, 1.f, &result);
+  EXPECT_EQ(std::vector<EntityId>{e1}, result);
+
+  result.clear();
+  index.queryRadius(SpatialPoint{3.f, 1.f}, 0.5f, &result);
+  EXPECT_EQ(std::vector<EntityId>{e2}, result);
+
+  // Removed entities are dropped from the index.
+  em.getEntity(e1)->remove();
+  em.update();
+  index.update();
+  EXPECT_EQ(1u, index.getSize());
+
+  result.clear();
+  index.queryRadius(SpatialPoint{100.f, 0.f}, 1.f, &result);
+  EXPECT_TRUE(result.empty());
+}
+
+}  // namespace ju